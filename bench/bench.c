@@ -0,0 +1,864 @@
+#define _GNU_SOURCE // mkdtemp
+#include "generator.h"
+#include "driver.h"
+#include "lexer.h"
+#include "parser.h"
+#include "codegen.h"
+#include "optimize.h"
+#include "scan.h"
+#include "threadpool.h"
+#include "toolchain.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <spawn.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+extern char **environ;
+
+// 逐个阶段测量编译器的耗时：每个阶段单独重复执行，输入都提前准备好，
+// 报告中位数、p99和吞吐量。结果以JSON写到标准输出（或--output指定的文件），
+// 便于在版本之间比较；可读的表格写到stderr
+
+typedef struct BenchConfig
+{
+    const char *name;
+    ProgramSpec spec;
+} BenchConfig;
+
+// 不指定程序参数时跑这一组
+static const BenchConfig default_suite[] = {
+    {"small", {50, 5, 1, 20, 10, 0, 1}},
+    {"medium", {1000, 10, 4, 40, 20, 0, 2}},
+    {"large", {10000, 10, 8, 40, 20, 0, 3}},
+    {"deep_calls", {2000, 4, 100, 20, 0, 0, 4}},
+    {"long_strings", {200, 10, 1, 4000, 0, 0, 5}},
+    {"comment_heavy", {1000, 10, 1, 20, 100, 0, 6}},
+    {"big_header", {200, 5, 1, 20, 10, 5000, 7}},
+};
+
+// 所有阶段共用的输入
+typedef struct BenchContext
+{
+    char source_path[PATH_MAX];
+    char c_path[PATH_MAX];
+    char output_path[PATH_MAX];
+    char *source; // 生成的完整程序
+    size_t source_size;
+    char *c_header; // 复制出来的C头：阶段函数要反复分离同一份源码，不能就地改写
+    const char *hercode_source;
+    Arena arena; // 预先解析好的AST，供代码生成阶段使用
+    ASTNode **nodes;
+    int node_count;
+    size_t token_count;
+    size_t c_size;
+    size_t run_output; // 生成的程序写到标准输出的字节数
+    int codegen_jobs; // 代码生成用的线程数
+} BenchContext;
+
+typedef int (*PhaseFn)(BenchContext *context);
+
+typedef struct PhaseResult
+{
+    const char *name;
+    int iterations;
+    double median_ms;
+    double p99_ms;
+    size_t bytes;  // 这个阶段处理的字节数，用来计算吞吐量
+    size_t tokens; // 词法和语法分析处理的token数，其他阶段为0
+} PhaseResult;
+
+static double now_ms(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1e3 + now.tv_nsec / 1e6;
+}
+
+static int phase_load_mmap(BenchContext *context)
+{
+    SourceFile file;
+    if (source_load(context->source_path, &file) != 0)
+        return -1;
+    // 映射只建立页表，摸一遍每一页才能和read比较
+    volatile char sum = 0;
+    for (size_t i = 0; i < file.length; i += 4096)
+        sum += file.data[i];
+    source_unload(&file);
+    return 0;
+}
+
+static int phase_load_read(BenchContext *context)
+{
+    SourceFile file;
+    if (source_read(context->source_path, &file) != 0)
+        return -1;
+    source_unload(&file);
+    return 0;
+}
+
+static int phase_separate_header(BenchContext *context)
+{
+    SourceView header, hercode;
+    separate_header(context->source, context->source_size, HERCODE_MAGIC, &header, &hercode);
+    return 0;
+}
+
+static int phase_lex(BenchContext *context)
+{
+    Arena arena;
+    arena_init(&arena);
+    Lexer *lexer = new_lexer(context->hercode_source, &arena);
+    size_t count = 0;
+    while (next_token(lexer).type != TOKEN_EOF)
+        count++;
+    arena_free(&arena);
+    context->token_count = count;
+    return 0;
+}
+
+static ASTNode **parse_source(BenchContext *context, Arena *arena, int *count)
+{
+    Lexer *lexer = new_lexer(context->hercode_source, arena);
+    Parser *parser = new_parser(lexer);
+    parser->filename = context->source_path;
+    return parse_program(parser, count);
+}
+
+// 包括词法分析：解析器按需取token，两者没法分开执行
+static int phase_parse(BenchContext *context)
+{
+    Arena arena;
+    arena_init(&arena);
+    int count;
+    ASTNode **nodes = parse_source(context, &arena, &count);
+    arena_free(&arena);
+    return nodes ? 0 : -1;
+}
+
+static int phase_codegen(BenchContext *context)
+{
+    CodeBuffer output;
+    codebuf_init(&output, 1 << 16);
+    generate_c_code(context->c_header, context->nodes, context->node_count, PRELUDE_FULL, context->codegen_jobs,
+                    &output);
+    int failed = output.failed;
+    context->c_size = output.length;
+    codebuf_free(&output);
+    return failed ? -1 : 0;
+}
+
+static int phase_compile(BenchContext *context)
+{
+    return compile(context->c_path, context->output_path, stderr) == 0 ? 0 : -1;
+}
+
+// 运行生成的程序，标准输出写到/dev/null或者经过管道读走；
+// 后者包括管道本身的开销，更接近输出被另一个程序消费的情况
+static int run_output(BenchContext *context, int use_pipe)
+{
+    int fds[2] = {-1, -1};
+    if (use_pipe && pipe2(fds, O_CLOEXEC) != 0)
+        return -1;
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, 0, "/dev/null", O_RDONLY, 0);
+    if (use_pipe)
+        posix_spawn_file_actions_adddup2(&actions, fds[1], 1);
+    else
+        posix_spawn_file_actions_addopen(&actions, 1, "/dev/null", O_WRONLY, 0);
+    char *argv[] = {context->output_path, NULL};
+    pid_t pid;
+    int err = posix_spawn(&pid, context->output_path, &actions, NULL, argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    if (use_pipe)
+        close(fds[1]);
+    if (err != 0)
+    {
+        if (use_pipe)
+            close(fds[0]);
+        return -1;
+    }
+
+    if (use_pipe)
+    {
+        size_t total = 0;
+        char buffer[1 << 16];
+        for (;;)
+        {
+            ssize_t n = read(fds[0], buffer, sizeof(buffer));
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                break;
+            total += (size_t)n;
+        }
+        close(fds[0]);
+        context->run_output = total;
+    }
+    int status;
+    while (waitpid(pid, &status, 0) < 0)
+        if (errno != EINTR)
+            return -1;
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? 0 : -1;
+}
+
+static int phase_run_pipe(BenchContext *context)
+{
+    return run_output(context, 1);
+}
+
+static int phase_run_devnull(BenchContext *context)
+{
+    return run_output(context, 0);
+}
+
+static int compare_double(const void *a, const void *b)
+{
+    double x = *(const double *)a, y = *(const double *)b;
+    return x < y ? -1 : x > y;
+}
+
+// 先执行一次预热，再计时iterations次
+static int run_phase(const char *name, PhaseFn fn, BenchContext *context, int iterations,
+                     size_t bytes, PhaseResult *result)
+{
+    double *samples = malloc(iterations * sizeof(double));
+    if (!samples || fn(context) != 0)
+    {
+        fprintf(stderr, "Error: benchmark phase %s failed\n", name);
+        free(samples);
+        return -1;
+    }
+    for (int i = 0; i < iterations; i++)
+    {
+        double start = now_ms();
+        if (fn(context) != 0)
+        {
+            fprintf(stderr, "Error: benchmark phase %s failed\n", name);
+            free(samples);
+            return -1;
+        }
+        samples[i] = now_ms() - start;
+    }
+    qsort(samples, iterations, sizeof(double), compare_double);
+
+    result->name = name;
+    result->iterations = iterations;
+    result->median_ms = iterations % 2 ? samples[iterations / 2]
+                                       : (samples[iterations / 2 - 1] + samples[iterations / 2]) / 2;
+    int p99 = (iterations * 99 + 99) / 100 - 1; // ceil(0.99n)-1
+    result->p99_ms = samples[p99];
+    result->bytes = bytes;
+    result->tokens = 0;
+    free(samples);
+    return 0;
+}
+
+static double throughput(const PhaseResult *result)
+{
+    return result->median_ms > 0 ? result->bytes / (result->median_ms * 1e3) : 0;
+}
+
+static double token_rate(const PhaseResult *result)
+{
+    return result->median_ms > 0 ? result->tokens / (result->median_ms * 1e3) : 0;
+}
+
+static int write_file(const char *path, const char *data, size_t size)
+{
+    FILE *file = fopen(path, "wb");
+    if (!file)
+        return -1;
+    size_t written = fwrite(data, 1, size, file);
+    return fclose(file) == 0 && written == size ? 0 : -1;
+}
+
+// 生成程序、写临时文件并准备好各阶段的输入
+static int prepare_context(BenchContext *context, const ProgramSpec *spec, const char *dir, int codegen_jobs)
+{
+    memset(context, 0, sizeof(*context));
+    context->codegen_jobs = codegen_jobs;
+    snprintf(context->source_path, sizeof(context->source_path), "%s/bench.hercode", dir);
+    snprintf(context->c_path, sizeof(context->c_path), "%s/bench.c", dir);
+    snprintf(context->output_path, sizeof(context->output_path), "%s/bench.out", dir);
+
+    char *program = generate_program(spec, &context->source_size);
+    if (!program || write_file(context->source_path, program, context->source_size) != 0)
+    {
+        free(program);
+        fprintf(stderr, "Error: cannot write %s\n", context->source_path);
+        return -1;
+    }
+    context->source = program;
+    SourceView header, hercode;
+    separate_header(context->source, context->source_size, HERCODE_MAGIC, &header, &hercode);
+    if (header.data)
+        context->c_header = strndup(header.data, header.length);
+    context->hercode_source = hercode.data;
+
+    arena_init(&context->arena);
+    context->nodes = parse_source(context, &context->arena, &context->node_count);
+    if (!context->nodes)
+        return -1;
+
+    CodeBuffer code;
+    codebuf_init(&code, 1 << 16);
+    generate_c_code(context->c_header, context->nodes, context->node_count, PRELUDE_FULL, 1, &code);
+    int status = code.failed ? -1 : write_file(context->c_path, code.data, code.length);
+    codebuf_free(&code);
+    return status;
+}
+
+static void free_context(BenchContext *context)
+{
+    unlink(context->source_path);
+    unlink(context->c_path);
+    unlink(context->output_path);
+    arena_free(&context->arena);
+    free(context->c_header);
+    free(context->source);
+}
+
+static void print_json_string(FILE *out, const char *text)
+{
+    fputc('"', out);
+    for (const char *p = text; *p; p++)
+    {
+        if (*p == '"' || *p == '\\')
+            fprintf(out, "\\%c", *p);
+        else if ((unsigned char)*p < 0x20)
+            fprintf(out, "\\u%04x", *p);
+        else
+            fputc(*p, out);
+    }
+    fputc('"', out);
+}
+
+static void print_config_json(FILE *out, const char *name, const ProgramSpec *spec,
+                              const BenchContext *context, const PhaseResult *results, int count, int last)
+{
+    fprintf(out, "    {\n      \"name\": ");
+    print_json_string(out, name);
+    fprintf(out, ",\n      \"spec\": {\"functions\": %d, \"body\": %d, \"depth\": %d, \"string_length\": %d, "
+                 "\"comment_percent\": %d, \"header_lines\": %d, \"seed\": %u},\n",
+            spec->functions, spec->body, spec->depth, spec->string_length, spec->comment_percent,
+            spec->header_lines, spec->seed);
+    fprintf(out, "      \"source_bytes\": %zu,\n      \"tokens\": %zu,\n      \"c_bytes\": %zu,\n"
+                 "      \"output_bytes\": %zu,\n",
+            context->source_size, context->token_count, context->c_size, context->run_output);
+    fprintf(out, "      \"phases\": [\n");
+    for (int i = 0; i < count; i++)
+    {
+        fprintf(out, "        {\"name\": \"%s\", \"iterations\": %d, \"median_ms\": %.4f, \"p99_ms\": %.4f, "
+                     "\"bytes\": %zu, \"mb_per_s\": %.2f",
+                results[i].name, results[i].iterations, results[i].median_ms, results[i].p99_ms,
+                results[i].bytes, throughput(&results[i]));
+        if (results[i].tokens)
+            fprintf(out, ", \"tokens_per_s\": %.0f", token_rate(&results[i]) * 1e6);
+        fprintf(out, "}%s\n", i + 1 < count ? "," : "");
+    }
+    fprintf(out, "      ]\n    }%s\n", last ? "" : ",");
+}
+
+static int parse_int_option(const char *arg, const char *prefix, int *value)
+{
+    size_t length = strlen(prefix);
+    if (strncmp(arg, prefix, length) != 0)
+        return 0;
+    *value = atoi(arg + length);
+    return 1;
+}
+
+static void print_json_header(FILE *out, int codegen_jobs)
+{
+    char version[256];
+    if (cc_version(version, sizeof(version)) != 0)
+        strcpy(version, "unknown");
+    version[strcspn(version, "\n")] = '\0';
+    fprintf(out, "{\n  \"format\": 1,\n  \"timestamp\": %lld,\n  \"scanner\": \"%s\",\n  \"cpus\": %d,\n"
+                 "  \"codegen_jobs\": %d,\n  \"cc\": ",
+            (long long)time(NULL), scan_implementation(), cpu_count(), codegen_jobs);
+    print_json_string(out, version);
+    fputs(",\n", out);
+}
+
+// 每个程序逐个阶段计时
+static int run_suite(const BenchConfig *configs, int config_count, const char *dir, int codegen_jobs,
+                     int iterations, int compile_iterations, int run_compile, FILE *out)
+{
+    int status = 0;
+    fprintf(out, "  \"configs\": [\n");
+    fprintf(stderr, "%-14s %-16s %10s %10s %10s %10s\n", "program", "phase", "median ms", "p99 ms", "MB/s",
+            "Mtok/s");
+    for (int c = 0; c < config_count && status == 0; c++)
+    {
+        BenchContext context;
+        PhaseResult results[9];
+        int count = 0;
+        if (prepare_context(&context, &configs[c].spec, dir, codegen_jobs) != 0)
+        {
+            fprintf(stderr, "Error: cannot prepare benchmark program %s\n", configs[c].name);
+            free_context(&context);
+            status = 1;
+            break;
+        }
+
+        size_t source = context.source_size;
+        size_t hercode = source - (context.hercode_source - context.source);
+        status |= run_phase("load_mmap", phase_load_mmap, &context, iterations, source, &results[count++]);
+        status |= run_phase("load_read", phase_load_read, &context, iterations, source, &results[count++]);
+        status |= run_phase("separate_header", phase_separate_header, &context, iterations, source, &results[count++]);
+        status |= run_phase("lex", phase_lex, &context, iterations, hercode, &results[count++]);
+        results[count - 1].tokens = context.token_count;
+        status |= run_phase("parse_program", phase_parse, &context, iterations, hercode, &results[count++]);
+        results[count - 1].tokens = context.token_count;
+        if (status == 0)
+            status |= run_phase("generate_c_code", phase_codegen, &context, iterations, 0, &results[count++]);
+        if (status == 0)
+            results[count - 1].bytes = context.c_size;
+        if (status == 0 && run_compile)
+            status |= run_phase("compile", phase_compile, &context, compile_iterations, context.c_size,
+                                &results[count++]);
+        // 生成的程序本身的运行时间，吞吐量按它的输出字节数计算
+        if (status == 0 && run_compile)
+            status |= run_phase("run_pipe", phase_run_pipe, &context, iterations, 0, &results[count++]);
+        if (status == 0 && run_compile)
+        {
+            results[count - 1].bytes = context.run_output;
+            status |= run_phase("run_devnull", phase_run_devnull, &context, iterations, context.run_output,
+                                &results[count++]);
+        }
+
+        if (status == 0)
+        {
+            for (int i = 0; i < count; i++)
+            {
+                fprintf(stderr, "%-14s %-16s %10.3f %10.3f %10.1f", configs[c].name, results[i].name,
+                        results[i].median_ms, results[i].p99_ms, throughput(&results[i]));
+                if (results[i].tokens)
+                    fprintf(stderr, " %10.2f", token_rate(&results[i]));
+                fputc('\n', stderr);
+            }
+            print_config_json(out, configs[c].name, &configs[c].spec, &context, results, count,
+                              c + 1 == config_count);
+        }
+        free_context(&context);
+    }
+    fprintf(out, "  ]\n");
+    return status;
+}
+
+static const int scaling_jobs[] = {1, 2, 4, 8, 16};
+#define SCALING_POINTS (int)(sizeof(scaling_jobs) / sizeof(scaling_jobs[0]))
+
+// 并行代码生成的输出必须和串行的逐字节相同
+static int check_determinism(const BenchConfig *configs, int config_count, const char *dir)
+{
+    int status = 0;
+    for (int c = 0; c < config_count && status == 0; c++)
+    {
+        BenchContext context;
+        if (prepare_context(&context, &configs[c].spec, dir, 1) != 0)
+        {
+            fprintf(stderr, "Error: cannot prepare benchmark program %s\n", configs[c].name);
+            free_context(&context);
+            return 1;
+        }
+        CodeBuffer serial;
+        codebuf_init(&serial, 1 << 16);
+        generate_c_code(context.c_header, context.nodes, context.node_count, PRELUDE_FULL, 1, &serial);
+        for (int i = 1; i < SCALING_POINTS; i++)
+        {
+            CodeBuffer parallel;
+            codebuf_init(&parallel, 1 << 16);
+            generate_c_code(context.c_header, context.nodes, context.node_count, PRELUDE_FULL, scaling_jobs[i],
+                            &parallel);
+            int same = !serial.failed && !parallel.failed && serial.length == parallel.length &&
+                       memcmp(serial.data, parallel.data, serial.length) == 0;
+            fprintf(stderr, "%-14s -j%-3d %zu bytes: %s\n", configs[c].name, scaling_jobs[i], parallel.length,
+                    same ? "identical" : "DIFFERENT");
+            if (!same)
+                status = 1;
+            codebuf_free(&parallel);
+        }
+        codebuf_free(&serial);
+        free_context(&context);
+    }
+    return status;
+}
+
+#define INLINE_CHECK_CALLS 200000
+
+// -O2内联之后main可能比原来的顶层节点多得多：一个8条say的函数在start:里调用
+// INLINE_CHECK_CALLS次，优化结果必须正好是展开后的全部say，生成的C代码也要成功
+static int check_inlining(void)
+{
+    static const char call[] = "    f\n";
+    size_t length = sizeof(call) - 1;
+    char *source = malloc(INLINE_CHECK_CALLS * length + 256);
+    if (!source)
+        return 1;
+    char *p = source;
+    p += sprintf(p, "function f:\n");
+    for (int i = 0; i < INLINE_MAX_STATEMENTS; i++)
+        p += sprintf(p, "    say \"line %d\"\n", i);
+    p += sprintf(p, "end\nstart:\n");
+    for (int i = 0; i < INLINE_CHECK_CALLS; i++, p += length)
+        memcpy(p, call, length);
+    strcpy(p, "end\n");
+
+    Arena arena;
+    arena_init(&arena);
+    Parser *parser = new_parser(new_lexer(source, &arena));
+    parser->filename = "<inline-check>";
+    int count;
+    ASTNode **nodes = parse_program(parser, &count);
+    OptimizeStats stats;
+    int status = !nodes || optimize_program(&nodes, &count, NULL, OPT_FULL, &arena, "<inline-check>", stderr,
+                                            &stats) != 0;
+    int expected = INLINE_CHECK_CALLS * INLINE_MAX_STATEMENTS;
+    for (int i = 0; status == 0 && i < count; i++)
+    {
+        if (nodes[i]->type != STMT_SAY)
+        {
+            fprintf(stderr, "node %d after inlining is not a say statement\n", i);
+            status = 1;
+        }
+    }
+    if (status == 0 && count != expected)
+    {
+        fprintf(stderr, "inlining produced %d statements, expected %d\n", count, expected);
+        status = 1;
+    }
+    if (status == 0)
+    {
+        CodeBuffer code;
+        codebuf_init(&code, 1 << 16);
+        generate_c_code(NULL, nodes, count, PRELUDE_FULL, 1, &code);
+        status = code.failed;
+        codebuf_free(&code);
+    }
+    fprintf(stderr, "inlining %d calls of an %d-statement function: %s\n", INLINE_CHECK_CALLS,
+            INLINE_MAX_STATEMENTS, status ? "FAILED" : "ok");
+    arena_free(&arena);
+    free(source);
+    return status;
+}
+
+// 代码生成在1到16个线程上的中位数耗时和加速比
+static int run_scaling(const BenchConfig *config, const char *dir, int iterations, FILE *out)
+{
+    PhaseResult results[SCALING_POINTS];
+    BenchContext context;
+    if (prepare_context(&context, &config->spec, dir, 1) != 0)
+    {
+        fprintf(stderr, "Error: cannot prepare benchmark program %s\n", config->name);
+        free_context(&context);
+        return 1;
+    }
+    for (int i = 0; i < SCALING_POINTS; i++)
+    {
+        context.codegen_jobs = scaling_jobs[i];
+        if (run_phase("generate_c_code", phase_codegen, &context, iterations, context.c_size, &results[i]) != 0)
+        {
+            free_context(&context);
+            return 1;
+        }
+        results[i].bytes = context.c_size;
+    }
+
+    fprintf(stderr, "generate_c_code on %s (%d functions, %d CPUs online)\n", config->name,
+            config->spec.functions, cpu_count());
+    fprintf(out, "  \"scaling\": {\"program\": ");
+    print_json_string(out, config->name);
+    fprintf(out, ", \"functions\": %d, \"points\": [\n", config->spec.functions);
+    for (int i = 0; i < SCALING_POINTS; i++)
+    {
+        double speedup = results[i].median_ms > 0 ? results[0].median_ms / results[i].median_ms : 0;
+        char bar[41];
+        int width = (int)(speedup * 10 + 0.5); // 每10格代表1倍
+        if (width > 40)
+            width = 40;
+        memset(bar, '#', width);
+        bar[width] = '\0';
+        fprintf(stderr, "  -j%-3d %10.3f ms %6.2fx %s\n", scaling_jobs[i], results[i].median_ms, speedup, bar);
+        fprintf(out, "    {\"jobs\": %d, \"median_ms\": %.4f, \"p99_ms\": %.4f, \"speedup\": %.3f}%s\n",
+                scaling_jobs[i], results[i].median_ms, results[i].p99_ms, speedup,
+                i + 1 < SCALING_POINTS ? "," : "");
+    }
+    fprintf(out, "  ]}\n");
+    free_context(&context);
+    return 0;
+}
+
+// 解析器规模测试：顶层语句数翻倍时耗时和内存都应线性增长，深层缩进也不能让
+// 内存或耗时退化。内存按arena实际申请的块大小计算，包括未用完的部分
+#define PARSER_MAX_BYTES_PER_STATEMENT 96 // 实测约65字节/条，留出块翻倍增长的余量
+#define PARSER_MAX_BYTES_PER_LEVEL 256    // 深层缩进每层还要保存缩进栈和嵌套的语句数组，实测约200字节
+#define PARSER_MAX_TIME_RATIO 2.0         // 最大规模每条语句的耗时不超过最小规模的2倍
+#define PARSER_DEEP_INDENT 10000
+
+static const int parser_scaling_statements[] = {250000, 500000, 1000000};
+#define PARSER_SCALING_POINTS (int)(sizeof(parser_scaling_statements) / sizeof(parser_scaling_statements[0]))
+
+typedef struct ParserScalingResult
+{
+    int statements;
+    size_t source_bytes;
+    double median_ms;
+    size_t arena_bytes;
+} ParserScalingResult;
+
+// count条顶层say
+static char *flat_program(int count, size_t *size)
+{
+    static const char line[] = "\tsay \"statement\"\n";
+    size_t length = sizeof(line) - 1;
+    char *program = malloc(length * count + 16);
+    if (!program)
+        return NULL;
+    char *p = program;
+    p += sprintf(p, "start:\n");
+    for (int i = 0; i < count; i++, p += length)
+        memcpy(p, line, length);
+    p += sprintf(p, "end\n");
+    *size = p - program;
+    return program;
+}
+
+// 一个函数体内每行比上一行多缩进一个空格，共depth层
+static char *deep_program(int depth, size_t *size)
+{
+    static const char line[] = "say \"deep\"\n";
+    size_t length = sizeof(line) - 1;
+    char *program = malloc((size_t)depth * (depth + 1) / 2 + (size_t)depth * length + 64);
+    if (!program)
+        return NULL;
+    char *p = program;
+    p += sprintf(p, "function deep:\n");
+    for (int i = 1; i <= depth; i++, p += length)
+    {
+        memset(p, ' ', i);
+        p += i;
+        memcpy(p, line, length);
+    }
+    p += sprintf(p, "end\nstart:\n    deep\nend\n");
+    *size = p - program;
+    return program;
+}
+
+static size_t arena_reserved(const Arena *arena)
+{
+    size_t total = 0;
+    for (const ArenaChunk *chunk = arena->head; chunk; chunk = chunk->next)
+        total += sizeof(ArenaChunk) + chunk->size;
+    return total;
+}
+
+// 解析iterations次取中位数，内存取最后一次的arena大小
+static int time_parser(const char *source, int iterations, ParserScalingResult *result)
+{
+    double *samples = malloc(iterations * sizeof(double));
+    if (!samples)
+        return -1;
+    for (int i = 0; i < iterations; i++)
+    {
+        Arena arena;
+        arena_init(&arena);
+        double start = now_ms();
+        Parser *parser = new_parser(new_lexer(source, &arena));
+        parser->filename = "<parser-scaling>";
+        int count;
+        ASTNode **nodes = parse_program(parser, &count);
+        samples[i] = now_ms() - start;
+        result->arena_bytes = arena_reserved(&arena);
+        arena_free(&arena);
+        if (!nodes)
+        {
+            free(samples);
+            return -1;
+        }
+    }
+    qsort(samples, iterations, sizeof(double), compare_double);
+    result->median_ms = iterations % 2 ? samples[iterations / 2]
+                                       : (samples[iterations / 2 - 1] + samples[iterations / 2]) / 2;
+    free(samples);
+    return 0;
+}
+
+static void print_parser_point_json(FILE *out, const ParserScalingResult *result, const char *suffix)
+{
+    fprintf(out, "{\"statements\": %d, \"source_bytes\": %zu, \"median_ms\": %.4f, \"ns_per_statement\": %.2f, "
+                 "\"arena_bytes\": %zu, \"bytes_per_statement\": %.2f}%s\n",
+            result->statements, result->source_bytes, result->median_ms,
+            result->median_ms * 1e6 / result->statements, result->arena_bytes,
+            (double)result->arena_bytes / result->statements, suffix);
+}
+
+static int run_parser_scaling(int iterations, FILE *out)
+{
+    ParserScalingResult results[PARSER_SCALING_POINTS + 1];
+    for (int i = 0; i <= PARSER_SCALING_POINTS; i++)
+    {
+        int deep = i == PARSER_SCALING_POINTS;
+        results[i].statements = deep ? PARSER_DEEP_INDENT : parser_scaling_statements[i];
+        char *source = deep ? deep_program(PARSER_DEEP_INDENT, &results[i].source_bytes)
+                            : flat_program(results[i].statements, &results[i].source_bytes);
+        int status = source ? time_parser(source, iterations, &results[i]) : -1;
+        free(source);
+        if (status != 0)
+        {
+            fprintf(stderr, "Error: parsing the %d-statement program failed\n", results[i].statements);
+            return 1;
+        }
+    }
+
+    int status = 0;
+    fprintf(stderr, "%-12s %10s %12s %10s %10s %10s\n", "program", "statements", "source MB", "median ms",
+            "ns/stmt", "bytes/stmt");
+    for (int i = 0; i <= PARSER_SCALING_POINTS; i++)
+    {
+        double per_statement = (double)results[i].arena_bytes / results[i].statements;
+        int limit = i < PARSER_SCALING_POINTS ? PARSER_MAX_BYTES_PER_STATEMENT : PARSER_MAX_BYTES_PER_LEVEL;
+        fprintf(stderr, "%-12s %10d %12.1f %10.2f %10.1f %10.1f\n",
+                i < PARSER_SCALING_POINTS ? "flat" : "deep_indent", results[i].statements, results[i].source_bytes / 1e6, results[i].median_ms,
+                results[i].median_ms * 1e6 / results[i].statements, per_statement);
+        if (per_statement > limit)
+        {
+            fprintf(stderr, "  arena uses more than %d bytes per statement\n", limit);
+            status = 1;
+        }
+    }
+    const ParserScalingResult *first = &results[0], *last = &results[PARSER_SCALING_POINTS - 1];
+    double ratio = (last->median_ms / last->statements) / (first->median_ms / first->statements);
+    fprintf(stderr, "time per statement at %d vs %d statements: %.2fx (limit %.1fx)\n", last->statements,
+            first->statements, ratio, PARSER_MAX_TIME_RATIO);
+    if (ratio > PARSER_MAX_TIME_RATIO)
+        status = 1;
+
+    fprintf(out, "  \"parser_scaling\": {\"max_bytes_per_statement\": %d, \"max_bytes_per_level\": %d, "
+                 "\"max_time_ratio\": %.1f, \"time_ratio\": %.3f, \"passed\": %s,\n    \"points\": [\n",
+            PARSER_MAX_BYTES_PER_STATEMENT, PARSER_MAX_BYTES_PER_LEVEL, PARSER_MAX_TIME_RATIO, ratio,
+            status ? "false" : "true");
+    for (int i = 0; i < PARSER_SCALING_POINTS; i++)
+    {
+        fputs("      ", out);
+        print_parser_point_json(out, &results[i], i + 1 < PARSER_SCALING_POINTS ? "," : "");
+    }
+    fprintf(out, "    ],\n    \"deep_indent\": ");
+    print_parser_point_json(out, &results[PARSER_SCALING_POINTS], "");
+    fprintf(out, "  }\n");
+    return status;
+}
+
+int main(int argc, char *argv[])
+{
+    ProgramSpec custom = default_suite[1].spec;
+    int use_custom = 0;
+    int iterations = 20;
+    int compile_iterations = 3;
+    int run_compile = 1;
+    int codegen_jobs = 1;
+    int determinism = 0;
+    int scaling = 0;
+    int parser_scaling = 0;
+    int inlining = 0;
+    const char *output_path = NULL;
+    for (int i = 1; i < argc; i++)
+    {
+        int seed;
+        if (parse_int_option(argv[i], "--functions=", &custom.functions) ||
+            parse_int_option(argv[i], "--body=", &custom.body) ||
+            parse_int_option(argv[i], "--depth=", &custom.depth) ||
+            parse_int_option(argv[i], "--string-length=", &custom.string_length) ||
+            parse_int_option(argv[i], "--comments=", &custom.comment_percent) ||
+            parse_int_option(argv[i], "--header-lines=", &custom.header_lines))
+            use_custom = 1;
+        else if (parse_int_option(argv[i], "--seed=", &seed))
+            custom.seed = (unsigned)seed;
+        else if (parse_int_option(argv[i], "--iterations=", &iterations) ||
+                 parse_int_option(argv[i], "--compile-iterations=", &compile_iterations) ||
+                 parse_int_option(argv[i], "--jobs=", &codegen_jobs))
+            continue;
+        else if (strcmp(argv[i], "--no-compile") == 0)
+            run_compile = 0;
+        else if (strcmp(argv[i], "--check-determinism") == 0)
+            determinism = 1;
+        else if (strcmp(argv[i], "--scaling") == 0)
+            scaling = 1;
+        else if (strcmp(argv[i], "--parser-scaling") == 0)
+            parser_scaling = 1;
+        else if (strcmp(argv[i], "--check-inlining") == 0)
+            inlining = 1;
+        else if (strncmp(argv[i], "--output=", 9) == 0)
+            output_path = argv[i] + 9;
+        else
+        {
+            fprintf(stderr, "Usage: %s [--functions=N] [--body=N] [--depth=N] [--string-length=N]\n"
+                            "       [--comments=PERCENT] [--header-lines=N] [--seed=N]\n"
+                            "       [--iterations=N] [--compile-iterations=N] [--no-compile] [--jobs=N]\n"
+                            "       [--check-determinism | --check-inlining | --scaling | --parser-scaling]\n"
+                            "       [--output=file.json]\n"
+                            "Without program parameters a built-in suite of programs is measured.\n"
+                            "--check-determinism compares parallel code generation with the serial output;\n"
+                            "--check-inlining checks that -O2 can grow start: far past the parsed program;\n"
+                            "--scaling times code generation on 1-16 threads (large program by default);\n"
+                            "--parser-scaling parses 250k-1M statements and 10k-deep indentation and fails\n"
+                            "when time per statement or arena memory per statement grows too much.\n",
+                    argv[0]);
+            return 1;
+        }
+    }
+    if (iterations < 1 || compile_iterations < 1 || codegen_jobs < 1 || custom.functions < 1 || custom.body < 1)
+    {
+        fprintf(stderr, "Error: iteration, job, function and body counts must be positive\n");
+        return 1;
+    }
+
+    BenchConfig custom_config = {"custom", custom};
+    const BenchConfig *configs = use_custom ? &custom_config : default_suite;
+    int config_count = use_custom ? 1 : (int)(sizeof(default_suite) / sizeof(default_suite[0]));
+
+    if (inlining)
+        return check_inlining();
+
+    char dir[] = "/tmp/hercode-bench-XXXXXX";
+    if (!mkdtemp(dir))
+    {
+        perror("mkdtemp");
+        return 1;
+    }
+    if (determinism)
+    {
+        int status = check_determinism(configs, config_count, dir);
+        rmdir(dir);
+        return status;
+    }
+
+    FILE *out = output_path ? fopen(output_path, "w") : stdout;
+    if (!out)
+    {
+        fprintf(stderr, "Error: cannot write %s\n", output_path);
+        rmdir(dir);
+        return 1;
+    }
+    print_json_header(out, codegen_jobs);
+    int status;
+    if (parser_scaling)
+        status = run_parser_scaling(iterations, out);
+    else if (scaling)
+        status = run_scaling(use_custom ? &custom_config : &default_suite[2], dir, iterations, out);
+    else
+        status = run_suite(configs, config_count, dir, codegen_jobs, iterations, compile_iterations,
+                           run_compile, out);
+    fprintf(out, "}\n");
+    if (output_path)
+        fclose(out);
+    rmdir(dir);
+    return status != 0;
+}
@@ -0,0 +1,79 @@
+#define _GNU_SOURCE // open_memstream
+#include "generator.h"
+#include "driver.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+// xorshift32，保证不同平台上生成的程序一样
+static unsigned next_random(unsigned *state)
+{
+    unsigned x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+static void write_text(FILE *out, unsigned *state, int length, const char *alphabet, int alphabet_size)
+{
+    for (int i = 0; i < length; i++)
+        fputc(alphabet[next_random(state) % alphabet_size], out);
+}
+
+char *generate_program(const ProgramSpec *spec, size_t *size)
+{
+    // 字符串里夹杂一些需要转义的字符，覆盖codegen的转义路径
+    static const char string_chars[] = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789   ,.!%\\";
+    static const char comment_chars[] = "abcdefghijklmnopqrstuvwxyz     ";
+    unsigned state = spec->seed ? spec->seed : 1;
+    int depth = spec->depth > 0 ? spec->depth : 1;
+
+    char *text = NULL;
+    FILE *out = open_memstream(&text, size);
+    if (!out)
+        return NULL;
+
+    if (spec->header_lines > 0)
+    {
+        fprintf(out, "#include <stdio.h>\n");
+        for (int i = 1; i < spec->header_lines; i++)
+            fprintf(out, "static int bench_value_%d = %u;\n", i, next_random(&state) % 1000);
+        fprintf(out, "%s\n", HERCODE_MAGIC);
+    }
+
+    for (int f = 0; f < spec->functions; f++)
+    {
+        int calls_next = f % depth != depth - 1 && f + 1 < spec->functions;
+        fprintf(out, "function bench_fn_%d:\n", f);
+        for (int s = 0; s < spec->body; s++)
+        {
+            if (calls_next && s == spec->body - 1)
+                fprintf(out, "\tbench_fn_%d", f + 1);
+            else
+            {
+                fputs("\tsay \"", out);
+                write_text(out, &state, spec->string_length, string_chars, sizeof(string_chars) - 1);
+                fputc('"', out);
+            }
+            if ((int)(next_random(&state) % 100) < spec->comment_percent)
+            {
+                fputs(" # ", out);
+                write_text(out, &state, 10 + next_random(&state) % 30, comment_chars, sizeof(comment_chars) - 1);
+            }
+            fputc('\n', out);
+        }
+        fprintf(out, "end\n");
+    }
+
+    fprintf(out, "start:\n");
+    for (int f = 0; f < spec->functions; f += depth)
+        fprintf(out, "\tbench_fn_%d\n", f);
+    fprintf(out, "end\n");
+
+    if (fclose(out) != 0)
+    {
+        free(text);
+        return NULL;
+    }
+    return text;
+}
@@ -0,0 +1,21 @@
+#ifndef BENCH_GENERATOR_H
+#define BENCH_GENERATOR_H
+
+#include <stddef.h>
+
+// 合成HerCode程序的参数
+typedef struct ProgramSpec
+{
+    int functions;       // 函数个数
+    int body;            // 每个函数的语句数
+    int depth;           // 调用链长度：每depth个函数依次调用下一个，start:调用每条链的第一个
+    int string_length;   // say字符串的长度
+    int comment_percent; // 带行尾注释的语句所占的百分比
+    int header_lines;    // "Hello! Her World"之前的C代码行数，0表示没有C头
+    unsigned seed;       // 相同参数和种子生成完全相同的程序
+} ProgramSpec;
+
+// 返回以'\0'结尾的程序文本（调用者free），长度写到size
+char *generate_program(const ProgramSpec *spec, size_t *size);
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stddef.h>
+
+// 一次编译使用一个arena：词法、语法分析和AST的内存都从这里分配，
+// 编译结束时调用arena_free一次性释放
+typedef struct ArenaChunk
+{
+    struct ArenaChunk *next;
+    size_t size; // data的容量
+    size_t used; // 已使用的字节数
+    _Alignas(16) char data[]; // 与arena_alloc的对齐保持一致
+} ArenaChunk;
+
+typedef struct Arena
+{
+    ArenaChunk *head;   // 当前正在分配的块（链表头）
+    size_t chunk_size;  // 下一个块的大小，按倍数增长
+    size_t alloc_count; // 从arena分配的次数
+    size_t chunk_count; // 实际调用malloc的次数
+    size_t bytes_used;  // 已分配的字节总数
+} Arena;
+
+void arena_init(Arena *arena);
+// 第一个块的大小由调用者指定，用于大量生命周期各自独立的小arena
+void arena_init_sized(Arena *arena, size_t first_chunk);
+void *arena_alloc(Arena *arena, size_t size);
+char *arena_strdup(Arena *arena, const char *str);
+char *arena_strndup(Arena *arena, const char *str, size_t len);
+void arena_free(Arena *arena);
+
+#endif
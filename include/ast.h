@@ -1,6 +1,9 @@
 #ifndef AST_H
 #define AST_H
 
+#include "arena.h"
+#include <stddef.h>
+
 typedef enum
 {
     STMT_SAY,
@@ -11,15 +14,16 @@ typedef enum
 typedef struct ASTNode
 {
     NodeType type;
-    char *value; // 对于函数，存储函数名
+    const char *value; // 对于函数，存储函数名；指向源码缓冲区，不以'\0'结尾
+    size_t length;     // value的长度
 
     // 函数定义的函数体
     struct ASTNode **body;
     int body_count;
 } ASTNode;
 
-ASTNode *create_say_node(char *str);
-void free_node(ASTNode *node);
-ASTNode *create_function_call_node(char *name);
-ASTNode *create_function_def_node(char *name, ASTNode **body, int body_count);
+// 节点和函数体属于arena，不需要单独释放；字符串引用源码，源码需比AST活得久
+ASTNode *create_say_node(Arena *arena, const char *str, size_t length);
+ASTNode *create_function_call_node(Arena *arena, const char *name, size_t length);
+ASTNode *create_function_def_node(Arena *arena, const char *name, size_t length, ASTNode **body, int body_count);
 #endif
\ No newline at end of file
@@ -0,0 +1,50 @@
+#ifndef AST_CACHE_H
+#define AST_CACHE_H
+
+#include "arena.h"
+#include "ast.h"
+#include "optimize.h"
+#include "sha256.h"
+#include "source.h"
+#include <pthread.h>
+
+// 编译服务器在内存里保留最近编译过的AST：键是源文件路径、源码内容的哈希和优化级别。
+// 命中时跳过词法分析、解析和优化。AST创建后只读，可以被多个请求同时使用
+#define AST_CACHE_DEFAULT_ENTRIES 64
+
+typedef struct AstCacheEntry
+{
+    struct AstCacheEntry *next;
+    char *path;
+    char hash[SHA256_HEX_SIZE];
+    OptLevel opt_level;
+    SourceFile source;    // AST和C头引用的源码，由条目持有；总是read读入的副本，不是映射
+    const char *c_header; // 指向source，没有C头时为NULL
+    Arena arena;    // AST节点
+    ASTNode **nodes;
+    int count;
+    int refs;    // 正在使用这个条目的请求数
+    int evicted; // 已经从链表中移除，最后一个使用者释放它
+} AstCacheEntry;
+
+typedef struct AstCache
+{
+    pthread_mutex_t lock;
+    AstCacheEntry *head; // 最近使用的在前
+    int count;
+    int max_entries;
+    unsigned long hits, misses;
+} AstCache;
+
+void ast_cache_init(AstCache *cache, int max_entries);
+void ast_cache_destroy(AstCache *cache);
+void ast_cache_hash(const char *source, size_t length, char hash[SHA256_HEX_SIZE]);
+// 命中时返回条目并增加引用计数，用完后调用ast_cache_release
+AstCacheEntry *ast_cache_acquire(AstCache *cache, const char *path, const char *hash, OptLevel opt_level);
+void ast_cache_release(AstCache *cache, AstCacheEntry *entry);
+// 保存一次编译的结果。source和arena的所有权转移给缓存（两者都被清空）；
+// 同一路径的旧条目被替换
+void ast_cache_insert(AstCache *cache, const char *path, const char *hash, OptLevel opt_level,
+                      SourceFile *source, const char *c_header, Arena *arena, ASTNode **nodes, int count);
+
+#endif
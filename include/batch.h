@@ -0,0 +1,12 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "driver.h"
+
+// 清单文件每行一个任务："源文件 [输出文件]"，空行和以#开头的行被忽略。
+// 省略输出文件时去掉源文件的.hercode后缀（没有后缀则加上.out）。
+// 最多jobs个文件同时编译（包括各自的gcc进程），每个文件的诊断信息在它
+// 完成后整体输出，不会和其他文件交错。全部成功返回0
+int compile_batch(const char *manifest_path, int jobs, const CompileOptions *options);
+
+#endif
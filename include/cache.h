@@ -0,0 +1,29 @@
+#ifndef CACHE_H
+#define CACHE_H
+
+#include "sha256.h"
+#include <limits.h>
+#include <stdio.h>
+
+// 内容寻址的构建缓存：键是源码、C头、编译参数和gcc版本的哈希，
+// 值是生成的可执行文件。命中时直接链接/复制，跳过代码生成和gcc。
+#define CACHE_DEFAULT_MAX_BYTES (512ULL * 1024 * 1024)
+
+typedef struct BuildCache
+{
+    char dir[PATH_MAX];
+    unsigned long long max_bytes; // 超过后按最近使用时间淘汰
+} BuildCache;
+
+// dir为NULL时依次使用$HERCODE_CACHE_DIR、$XDG_CACHE_HOME/hercode、~/.cache/hercode
+int cache_open(BuildCache *cache, const char *dir, unsigned long long max_bytes);
+// 计算缓存键，失败（例如无法取得gcc版本）返回-1
+int cache_compute_key(const char *hercode_source, const char *c_header, const char *flags,
+                      char key[SHA256_HEX_SIZE]);
+// 命中时把缓存的可执行文件放到output_path并返回1，未命中返回0
+int cache_lookup(BuildCache *cache, const char *key, const char *output_path);
+// 把刚生成的可执行文件存进缓存，必要时淘汰最久未用的条目
+int cache_store(BuildCache *cache, const char *key, const char *output_path);
+void cache_print_stats(BuildCache *cache, FILE *out);
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef CODEBUF_H
+#define CODEBUF_H
+
+#include <stddef.h>
+
+// 代码生成用的输出缓冲：只追加，满了翻倍，不解析格式串。生成完以后整块交给
+// 文件、管道或缓存，用一次write（多个缓冲用writev）写出，不经过stdio
+typedef struct CodeBuffer
+{
+    char *data;
+    size_t length;
+    size_t capacity;
+    int failed; // 内存不够时置1，之后的追加被忽略，写出时报告失败
+} CodeBuffer;
+
+void codebuf_init(CodeBuffer *buffer, size_t capacity);
+void codebuf_free(CodeBuffer *buffer);
+void codebuf_append(CodeBuffer *buffer, const char *data, size_t length);
+// 追加字符串字面量，长度在编译期算出
+#define codebuf_append_literal(buffer, literal) codebuf_append((buffer), "" literal, sizeof(literal) - 1)
+// 把缓冲区里已有的[offset, offset + length)再追加一遍；扩容不会让来源失效
+void codebuf_append_range(CodeBuffer *buffer, size_t offset, size_t length);
+void codebuf_append_char(CodeBuffer *buffer, char c);
+void codebuf_append_size(CodeBuffer *buffer, size_t value);
+// 追加C标识符prefix+name，name指向源码，不以'\0'结尾
+void codebuf_append_identifier(CodeBuffer *buffer, const char *prefix, const char *name, size_t length);
+// 把源码中的字符串片段转义成C字符串字面量的内容
+void codebuf_append_escaped(CodeBuffer *buffer, const char *str, size_t length);
+// 写出整个缓冲区，处理部分写入和EINTR；成功返回0
+int codebuf_write(const CodeBuffer *buffer, int fd);
+// 按顺序写出多个缓冲区，尽量少调用writev
+int codebuf_writev(CodeBuffer *const *buffers, int count, int fd);
+
+#endif
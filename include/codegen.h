@@ -1,14 +1,38 @@
 #include "ast.h"
+#include "codebuf.h"
+#include "prelude.h"
+#include "symtab.h"
 #include <stdio.h>
 typedef struct
 {
-    char *name;
+    const char *name;
+    size_t name_length;
     ASTNode **body;
     int body_count;
 } FunctionDef;
 
-// 最大函数数量
-#define MAX_FUNCTIONS 100
-FunctionDef *find_function(const char *name, FunctionDef **functions, int function_count);
-void generate_c_code(const char *c_header, ASTNode **nodes, int count, FILE *output);
-void compile(char *c_filename, char *output_name);
\ No newline at end of file
+// 顶层函数定义表：defs按定义顺序排列，def - defs就是函数下标；按名字查找用哈希表
+typedef struct
+{
+    FunctionDef *defs;
+    int count;
+    SymbolTable symbols;
+} FunctionTable;
+
+// 收集nodes里的顶层函数定义，内存从arena分配；重复定义只保留第一个（解析器已经报过错）
+void build_function_table(FunctionTable *table, ASTNode **nodes, int count, Arena *arena);
+FunctionDef *find_function(const FunctionTable *table, const char *name, size_t length);
+// generate_c_code的各个部分，--watch用它们按函数缓存生成的代码
+void write_function_declaration(CodeBuffer *output, const FunctionDef *def);
+void write_main_function(CodeBuffer *output, const char *c_header, ASTNode **nodes, int count);
+void write_function_definition(CodeBuffer *output, const FunctionDef *def);
+// 函数不少于CODEGEN_PARALLEL_MIN_FUNCTIONS个且jobs>1时，函数实现在jobs个线程上分块生成，
+// 输出和jobs=1时逐字节相同
+#define CODEGEN_PARALLEL_MIN_FUNCTIONS 512
+#define CODEGEN_CHUNK_FUNCTIONS 64
+void generate_c_code(const char *c_header, ASTNode **nodes, int count, PreludeMode prelude, int jobs,
+                     CodeBuffer *output);
+// 输出在编译时已经算出来的程序（见evaluate.h）：data放在一个静态数组里，main只调用write
+void generate_constant_program(const char *data, size_t length, CodeBuffer *output);
+// 编译已经写到磁盘上的C文件，返回gcc的退出码；gcc的错误输出写到diag
+int compile(const char *c_filename, const char *output_name, FILE *diag);
\ No newline at end of file
@@ -0,0 +1,12 @@
+#ifndef CODEGEN_X86_H
+#define CODEGEN_X86_H
+
+#include "ast.h"
+#include <stdio.h>
+
+// 原生后端：不经过gcc，直接生成x86-64 Linux的静态ELF可执行文件。
+// say变成write系统调用，函数变成call/ret。只适用于没有C头的程序。
+// 成功返回0，错误信息写到diag
+int generate_native_executable(ASTNode **nodes, int count, const char *output_name, FILE *diag);
+
+#endif
@@ -0,0 +1,53 @@
+#ifndef DRIVER_H
+#define DRIVER_H
+
+#include "ast_cache.h"
+#include "cache.h"
+#include "optimize.h"
+#include "prelude.h"
+#include "source.h"
+#include "timereport.h"
+#include <limits.h>
+#include <stdio.h>
+
+// 这一行之前是C代码，之后是HerCode
+#define HERCODE_MAGIC "Hello! Her World"
+
+typedef enum
+{
+    BACKEND_C,      // 生成C代码交给gcc
+    BACKEND_NATIVE, // 直接生成x86-64 ELF；带C头的文件仍然走C后端
+} Backend;
+
+// 编译选项，由main根据命令行填好；batch模式下所有文件共用同一份，只读
+typedef struct CompileOptions
+{
+    const char *emit_c_path; // 非NULL时先把C代码写到这个文件再编译
+    Backend backend;
+    PreludeMode prelude;
+    OptLevel opt_level;
+    BuildCache *cache; // 缓存目录不可用时为NULL
+    int use_cache;     // 是否查找/保存构建缓存
+    int show_stats;
+    int run; // 用字节码虚拟机直接执行，不生成可执行文件
+    int codegen_jobs; // 并行生成函数实现的线程数，0或1为串行
+    int split_units;  // 大于1时把函数分到这么多个翻译单元，并行gcc -c后链接
+    AstCache *ast_cache; // 编译服务器保留的AST，其他模式为NULL
+    TimeReport *time_report; // --time-report时非NULL，编译单个文件时把计时和计数写到这里
+    char prelude_path[PATH_MAX]; // PRELUDE_PCH时用-include引入的头文件
+} CompileOptions;
+
+// 在源码中找行首的magic_string：它前面是C头，下一行开始是HerCode部分，两段都只是source里的视图。
+// 没有分隔行时header->data为NULL，hercode是整个源码
+void separate_header(const char *source, size_t length, const char *magic_string,
+                     SourceView *header, SourceView *hercode);
+
+// 准备所有文件共用的资源（预编译prelude等），在编译任何文件之前调用一次
+void driver_prepare(CompileOptions *options);
+// 编译一个HerCode文件，所有诊断信息都写到diag，成功返回0。
+// options->run时output_name不使用，程序输出写到标准输出。
+// 不修改全局状态，可以在多个线程里同时调用
+int compile_file(const char *source_path, const char *output_name,
+                 const CompileOptions *options, FILE *diag);
+
+#endif
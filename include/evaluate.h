@@ -0,0 +1,16 @@
+#ifndef EVALUATE_H
+#define EVALUATE_H
+
+#include "arena.h"
+#include "ast.h"
+#include "codebuf.h"
+
+// 编译时求值的输出上限，超过就退回正常的代码生成
+#define EVALUATE_MAX_OUTPUT (1 << 20)
+
+// 没有C头的程序只有say和函数调用，输出在编译时就能确定：从start:沿着调用展开，
+// 把完整的输出写进output。每个函数只展开一次，再次调用时复制它上次的输出。
+// 遇到递归（程序永远不会结束）或者输出超过limit字节时返回-1，output的内容不可用
+int evaluate_program(ASTNode **nodes, int count, size_t limit, Arena *arena, CodeBuffer *output);
+
+#endif
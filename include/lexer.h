@@ -1,6 +1,9 @@
 #ifndef LEXER_H
 #define LEXER_H
 
+#include "arena.h"
+#include <stddef.h>
+
 typedef enum
 {
     TOKEN_EOF,
@@ -15,29 +18,58 @@ typedef enum
     TOKEN_DEDENT,
     TOKEN_COLON,
     TOKEN_FUNCTION,  // function 关键字
-    TOKEN_IDENTIFIER // 函数名
+    TOKEN_IDENTIFIER, // 函数名
+    TOKEN_TYPE_COUNT  // token类型的个数，不是token
 } TokenType;
 
+// token不复制文本，只记录它在源码缓冲区中的位置
 typedef struct Token
 {
     TokenType type;
-    char *value;
+    size_t offset; // 文本在整个输入中的起始位置
+    size_t length; // 文本长度（字符串不含引号）
 } Token;
 
+// 流式输入每次读入的大小，也是窗口的初始大小
+#define LEXER_WINDOW_SIZE (1 << 16)
+
 typedef struct Lexer
 {
-    char *source;
-    int pos;
+    Arena *arena; // lexer本身从这里分配，随arena一起释放
+    const char *source;
+    size_t pos; // 当前字节在source中的位置
     char current_char;
     int current_indent;    // 当前行的缩进（空格数）
-    int indent_stack[100]; // 缩进级别的栈，用于记录每一层的缩进量
+    int *indent_stack;     // 缩进级别的栈，用于记录每一层的缩进量；从arena分配，满了翻倍
+    int indent_capacity;
     int indent_top;        // 栈顶指针
     int pending_dedents;   // 待生成的DEDENT数量（当遇到减少缩进时，需要生成多个DEDENT）
+
+    // 流式输入：source指向窗口，里面是输入的[base, base + window_length)，以'\0'结尾。
+    // 扫描到窗口末尾时丢掉当前token之前的字节，再从fd读一块
+    int fd; // -1表示source是完整的源码
+    char *window;
+    size_t window_length;
+    size_t window_capacity;
+    size_t base; // 窗口第一个字节在整个输入中的位置，完整源码时为0
+    int eof;
+    int read_error; // 读fd失败时的errno
+
+    // 行号：输入的前line_offset个字节里有line个换行，窗口丢弃字节前先数完
+    size_t line_offset;
+    int line;
 } Lexer;
 
-Lexer *new_lexer(char *source);
-void free_lexer(Lexer *lexer);
-Token *next_token(Lexer *lexer);
-Token *handle_newline_and_indent(Lexer *lexer);
+Lexer *new_lexer(const char *source, Arena *arena);
+// 从fd分块读取输入，内存里只保留从当前token开始的一个窗口；prefix是已经从fd读出来的开头部分。
+// token_text返回的文本在下一次next_token之后可能被覆盖，需要保留时由调用者复制
+Lexer *new_stream_lexer(int fd, const char *prefix, size_t length, Arena *arena);
+int lexer_is_streaming(const Lexer *lexer);
+// 输入中offset之前有几个换行；流式输入时offset不能早于已经丢弃的部分
+int lexer_line(Lexer *lexer, size_t offset);
+Token next_token(Lexer *lexer);
+Token handle_newline_and_indent(Lexer *lexer);
+const char *token_text(const Lexer *lexer, Token token);
+const char *token_type_to_string(TokenType type);
 
 #endif
\ No newline at end of file
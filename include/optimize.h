@@ -0,0 +1,33 @@
+#ifndef OPTIMIZE_H
+#define OPTIMIZE_H
+
+#include "arena.h"
+#include "ast.h"
+#include <stdio.h>
+
+// -O0：只检查未定义的函数；-O1：删掉start:到不了的函数；-O2：再内联小函数
+typedef enum
+{
+    OPT_NONE = 0,
+    OPT_BASIC = 1,
+    OPT_FULL = 2,
+} OptLevel;
+
+// 内联后函数体不超过这么多条语句的非递归函数会被内联
+#define INLINE_MAX_STATEMENTS 8
+
+typedef struct
+{
+    int functions_removed;
+    int calls_inlined;
+    int recursive_functions; // 从start:能到达的递归函数个数
+} OptimizeStats;
+
+// 在parse_program和代码生成之间运行：建立调用图，报告未定义的函数和递归调用，
+// 按level删除死函数、内联小函数。*nodes和*count替换成优化后的结果，新节点从arena分配。
+// C头里出现的function_<name>当作外部引用：既是根，也可以作为被调用的外部函数。
+// 调用了未定义的函数时返回-1，错误写到diag
+int optimize_program(ASTNode ***nodes, int *count, const char *c_header, OptLevel level,
+                     Arena *arena, const char *filename, FILE *diag, OptimizeStats *stats);
+
+#endif
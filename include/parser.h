@@ -1,21 +1,38 @@
 #include "ast.h"
 #include "lexer.h"
+#include "symtab.h"
+#include <setjmp.h>
+#include <stdio.h>
 
 // parser.h
 typedef struct Parser
 {
     Lexer *lexer;
-    Token *current_token;
+    Token current_token;
     int current_indent; // 当前缩进级别
+
+    // 语法错误写到diag并跳回parse_program，不再直接exit，
+    // 这样一个进程可以同时编译多个文件
+    FILE *diag;
+    const char *filename; // 用于错误信息，可以为NULL
+    int first_line;       // lexer->source第一行在文件中的行号（前面可能有C头）
+    jmp_buf error_jump;
+
+    // 函数名驻留表：同名的定义和调用共用一个名字指针；Symbol.line记录定义所在行
+    SymbolTable functions;
 } Parser;
 
+// 解析器与lexer共用同一个arena
 Parser *new_parser(Lexer *lexer);
-void free_parser(Parser *parser);
-void free_token(Token *token);
-void free_token(Token *token);
+_Noreturn void parser_error(Parser *parser, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
 ASTNode *parse_statement(Parser *parser);
 ASTNode *parse_block(Parser *parser, int *count);
+// 出错时返回NULL，错误信息已写到parser->diag
 ASTNode **parse_program(Parser *parser, int *count);
+// 只解析函数定义（和start:之前允许出现的顶层语句），不要求start:块。
+// --watch用它单独解析一个函数所在的片段；出错时返回NULL
+ASTNode **parse_definitions(Parser *parser, int *count);
 ASTNode *parse_say_statement(Parser *parser);
 ASTNode *parse_function_definition(Parser *parser);
 ASTNode *parse_function_call(Parser *parser);
\ No newline at end of file
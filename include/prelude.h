@@ -0,0 +1,22 @@
+#ifndef PRELUDE_H
+#define PRELUDE_H
+
+#include "cache.h"
+#include "codebuf.h"
+#include <stdio.h>
+
+// 生成代码开头的标准库头文件块
+typedef enum
+{
+    PRELUDE_FULL,    // 直接写出全部头文件（与旧版本相同）
+    PRELUDE_PCH,     // 不写头文件，由gcc通过-include使用预编译的prelude
+    PRELUDE_MINIMAL, // 只写C头和生成代码实际用到的头文件
+} PreludeMode;
+
+// 按mode写出#include块；PCH模式下什么也不写
+void write_prelude(CodeBuffer *output, PreludeMode mode, const char *c_header);
+// 确保缓存目录里有预编译好的prelude，把-include要用的头文件路径写入header_path。
+// .gch按gcc版本区分，只在第一次使用时编译。失败返回-1，调用者应退回PRELUDE_FULL
+int prelude_prepare_pch(BuildCache *cache, char *header_path, size_t size);
+
+#endif
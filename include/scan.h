@@ -0,0 +1,15 @@
+#ifndef SCAN_H
+#define SCAN_H
+
+// 词法分析用的字节扫描。源码以'\0'结尾，扫描一定会停下来。
+// x86-64上按CPU在运行时选择AVX2或SSE2实现，其他平台用逐字节的实现。
+// 向量实现只做对齐的读取，不会越过'\0'所在的内存页
+
+// 返回从p开始第一个等于a或'\0'的字节
+const char *scan_find(const char *p, char a);
+// 返回从p开始第一个不是空格或制表符的字节
+const char *scan_skip_blanks(const char *p);
+// 当前使用的实现："avx2"、"sse2"或"scalar"
+const char *scan_implementation(void);
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include "driver.h"
+
+// 编译服务器：--server在Unix域套接字上常驻，预编译prelude只准备一次，
+// 最近编译过的AST留在内存里；--client把一次编译请求交给它并等待结果。
+//
+// 请求是若干"键 值"行，以空行结束：
+//   source /abs/path.hercode
+//   output /abs/path
+//   opt 0|1|2
+//   backend c|native
+//   stats 0|1
+// 响应第一行是"status N"，后面是这次编译的全部诊断信息，服务器随后关闭连接。
+// 请求必须在连接后10秒内发完，否则服务器按不完整的请求处理并关闭连接。
+
+// 在socket_path上监听，最多jobs个请求同时编译。收到SIGINT/SIGTERM后
+// 等待进行中的请求完成，删除套接字文件并返回0；无法监听时返回1
+int run_server(const char *socket_path, int jobs, const CompileOptions *options);
+// 按options中的优化级别、后端和--stats发送请求，把诊断信息写到stderr，
+// 返回编译的退出状态；连接不上服务器时返回1
+int run_client(const char *socket_path, const char *source_path, const char *output_name,
+               const CompileOptions *options);
+
+#endif
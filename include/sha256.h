@@ -0,0 +1,23 @@
+#ifndef SHA256_H
+#define SHA256_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define SHA256_DIGEST_SIZE 32
+#define SHA256_HEX_SIZE (SHA256_DIGEST_SIZE * 2 + 1)
+
+typedef struct Sha256
+{
+    uint32_t state[8];
+    uint64_t length; // 已处理的字节数
+    unsigned char block[64];
+    size_t block_used;
+} Sha256;
+
+void sha256_init(Sha256 *ctx);
+void sha256_update(Sha256 *ctx, const void *data, size_t size);
+// 输出64个十六进制字符加'\0'
+void sha256_final_hex(Sha256 *ctx, char hex[SHA256_HEX_SIZE]);
+
+#endif
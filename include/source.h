@@ -0,0 +1,32 @@
+#ifndef SOURCE_H
+#define SOURCE_H
+
+#include <stddef.h>
+
+// 读进内存的源文件。普通文件直接mmap，管道和特殊文件退回到read，读进一块缓冲区，不再复制。
+// 两种情况下data[length]都是'\0'，可以直接交给lexer和scan.h的向量扫描
+typedef struct SourceFile
+{
+    char *data;
+    size_t length;
+    size_t mapped_length; // mmap映射的长度，0表示data是malloc的
+} SourceFile;
+
+// 源码中的一段，指向SourceFile.data，不以'\0'结尾
+typedef struct SourceView
+{
+    const char *data;
+    size_t length;
+} SourceView;
+
+// 失败时返回-1，errno说明原因
+int source_load(const char *path, SourceFile *file);
+// 不映射，总是用read读入。--watch和编译服务器用它：编辑器保存时截断文件会让映射的访问收到SIGBUS
+int source_read(const char *path, SourceFile *file);
+// 从已经打开的fd读到文件结束；limit不为0时最多读这么多字节
+int source_read_fd(int fd, size_t limit, SourceFile *file);
+void source_unload(SourceFile *file);
+// "mmap"或"read"，--stats用
+const char *source_method(const SourceFile *file);
+
+#endif
@@ -0,0 +1,14 @@
+#ifndef SPLIT_H
+#define SPLIT_H
+
+#include "ast.h"
+#include "driver.h"
+
+// --split=K：函数实现按函数名的哈希分到K个翻译单元，main单独一个单元，
+// 它们共用一个生成的函数原型头文件。各单元用最多K个并发的gcc -c编译后再链接。
+// 有构建缓存目录时，目标文件按单元内容的哈希缓存，内容没变的单元直接复用。
+// 成功返回0
+int split_compile(const char *c_header, ASTNode **nodes, int count, const char *output_name,
+                  const CompileOptions *options, FILE *diag);
+
+#endif
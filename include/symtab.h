@@ -0,0 +1,33 @@
+#ifndef SYMTAB_H
+#define SYMTAB_H
+
+#include "arena.h"
+#include <stddef.h>
+#include <stdint.h>
+
+// 名字到任意值的开放寻址哈希表（线性探测），容量是2的幂，装载因子超过1/2时翻倍。
+// 表和扩容前的旧槽位都从arena分配，随arena一起释放
+typedef struct
+{
+    const char *name; // 驻留后的名字：同一个名字在表里只有这一个指针；NULL表示空槽
+    size_t length;
+    uint64_t hash;
+    void *value; // 由使用者决定，比如FunctionDef*
+    int line;    // 定义所在的行号，0表示还没有定义
+} Symbol;
+
+typedef struct
+{
+    Arena *arena;
+    Symbol *slots;
+    size_t capacity;
+    size_t count;
+} SymbolTable;
+
+void symtab_init(SymbolTable *table, Arena *arena, size_t expected);
+// 找不到时返回NULL
+Symbol *symtab_lookup(const SymbolTable *table, const char *name, size_t length);
+// 返回名字对应的符号，没有时插入一个value为NULL的新符号
+Symbol *symtab_intern(SymbolTable *table, const char *name, size_t length);
+
+#endif
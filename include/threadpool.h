@@ -0,0 +1,36 @@
+#ifndef THREADPOOL_H
+#define THREADPOOL_H
+
+#include <pthread.h>
+
+// 固定数量的工作线程，从一个先进先出的任务队列中取任务执行
+typedef void (*ThreadTask)(void *arg);
+
+typedef struct ThreadPoolTask
+{
+    ThreadTask fn;
+    void *arg;
+    struct ThreadPoolTask *next;
+} ThreadPoolTask;
+
+typedef struct ThreadPool
+{
+    pthread_t *threads;
+    int thread_count;
+    ThreadPoolTask *head, *tail;
+    int pending; // 已提交但还没执行完的任务数
+    int stopping;
+    pthread_mutex_t lock;
+    pthread_cond_t task_ready; // 有新任务或要停止
+    pthread_cond_t idle;       // pending降到0
+} ThreadPool;
+
+// thread_count<=0时使用在线CPU数
+ThreadPool *threadpool_create(int thread_count);
+void threadpool_submit(ThreadPool *pool, ThreadTask fn, void *arg);
+// 等待所有已提交的任务执行完
+void threadpool_wait(ThreadPool *pool);
+void threadpool_destroy(ThreadPool *pool);
+int cpu_count(void);
+
+#endif
@@ -0,0 +1,50 @@
+#ifndef TIMEREPORT_H
+#define TIMEREPORT_H
+
+#include "lexer.h"
+#include <stdio.h>
+#include <time.h>
+
+// --time-report：每个阶段的墙钟时间和CPU时间，以及编译过程中的计数器
+typedef enum
+{
+    PHASE_READ,     // source_load
+    PHASE_HEADER,   // separate_header
+    PHASE_LEX,      // 单独的一遍词法分析，同时按类型统计token
+    PHASE_PARSE,    // parse_program（解析器按需取token，包括一次词法分析）
+    PHASE_OPTIMIZE, // optimize_program
+    PHASE_CODEGEN,  // 生成C代码、字节码或ELF
+    PHASE_CC,       // 把C代码交给gcc并等待它结束；CPU时间是gcc及其子进程的
+    PHASE_RUN,      // --run时字节码虚拟机执行程序
+    PHASE_COUNT
+} Phase;
+
+typedef struct TimeReport
+{
+    double wall_ms[PHASE_COUNT];
+    double cpu_ms[PHASE_COUNT];
+    size_t bytes_read;
+    size_t tokens[TOKEN_TYPE_COUNT];
+    size_t token_total;
+    int ast_nodes; // 解析后、优化前，包括函数体里的语句
+    int functions;
+    size_t c_bytes;
+    long peak_rss_kb;    // 编译器进程
+    long cc_peak_rss_kb; // gcc及其子进程中最大的一个
+} TimeReport;
+
+typedef struct PhaseTimer
+{
+    struct timespec wall;
+    struct timespec cpu;
+    double child_cpu_ms;
+} PhaseTimer;
+
+// report为NULL（没有--time-report）时两个函数都什么也不做
+void phase_begin(const TimeReport *report, PhaseTimer *timer);
+// 把从phase_begin开始的时间累加到report的phase上
+void phase_end(TimeReport *report, Phase phase, const PhaseTimer *timer);
+// 打印报告；json非0时输出一个JSON对象
+void time_report_print(TimeReport *report, const char *source_path, int json, FILE *out);
+
+#endif
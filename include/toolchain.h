@@ -0,0 +1,33 @@
+#ifndef TOOLCHAIN_H
+#define TOOLCHAIN_H
+
+#include <stdio.h>
+#include <sys/types.h>
+
+// 调用C编译器：直接posix_spawn，不经过shell，也不在工作目录里写临时文件
+#define CC_PROGRAM "gcc"
+
+typedef struct CompileJob
+{
+    pid_t pid;
+    FILE *input;   // 写入这里的C代码通过管道送给gcc的标准输入
+    FILE *diag;    // gcc的错误输出最终写到这里
+    FILE *capture; // diag不是stderr时，gcc的stderr先写到这个临时文件
+} CompileJob;
+
+// 启动 gcc -x c [extra_args...] -o output_name -，成功返回0。
+// extra_args以NULL结尾，可以为NULL；diag为NULL时gcc直接写stderr
+int compile_begin(CompileJob *job, const char *output_name, char *const extra_args[], FILE *diag);
+// 关闭管道并等待gcc结束，返回gcc的退出码（失败返回-1）
+int compile_end(CompileJob *job);
+
+// 运行argv描述的命令并等待结束，返回退出码（失败返回-1）；
+// 命令的stderr写到diag（为NULL时直接写stderr）
+int run_command(char *const argv[], FILE *diag);
+// 同上，并把命令的标准输出读进buffer（以'\0'结尾，超出部分丢弃）
+int capture_command(char *const argv[], char *buffer, size_t size);
+// 取得C编译器的版本信息（gcc --version的输出），用作缓存键的一部分。
+// 结果在进程内只查询一次，可以从多个线程调用
+int cc_version(char *buffer, size_t size);
+
+#endif
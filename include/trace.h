@@ -0,0 +1,36 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+// 调试跟踪：默认不输出任何内容，用--trace=lexer,parser,codegen按类别打开。
+// 构建时定义HERCODE_NO_TRACE（cmake -DHERCODE_TRACE=OFF）后，
+// 所有TRACE调用在编译期被消除，参数也不会被求值。
+typedef enum
+{
+    TRACE_LEXER = 1 << 0,
+    TRACE_PARSER = 1 << 1,
+    TRACE_CODEGEN = 1 << 2,
+    TRACE_DRIVER = 1 << 3, // main中的流程信息
+    TRACE_ALL = TRACE_LEXER | TRACE_PARSER | TRACE_CODEGEN | TRACE_DRIVER
+} TraceCategory;
+
+extern unsigned trace_mask;
+
+// 解析形如"lexer,parser"的类别列表，未知类别返回-1
+int trace_parse(const char *spec);
+void trace_printf(TraceCategory category, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+#ifdef HERCODE_NO_TRACE
+#define TRACE_ENABLED(category) 0
+#define TRACE(category, ...) ((void)0)
+#else
+#define TRACE_ENABLED(category) (trace_mask & (category))
+#define TRACE(category, ...)                          \
+    do                                                \
+    {                                                 \
+        if (TRACE_ENABLED(category))                  \
+            trace_printf((category), __VA_ARGS__);    \
+    } while (0)
+#endif
+
+#endif
@@ -0,0 +1,37 @@
+#ifndef VM_H
+#define VM_H
+
+#include "arena.h"
+#include "ast.h"
+#include <stdint.h>
+#include <stdio.h>
+
+// --run用的字节码：不生成可执行文件，直接解释执行
+typedef enum
+{
+    OP_PRINT, // 操作数：常量下标，输出该常量
+    OP_CALL,  // 操作数：函数入口在code中的位置
+    OP_RET,
+    OP_HALT,
+} OpCode;
+
+typedef struct
+{
+    const char *text; // 已经带上换行符，连续的say合并成一个常量
+    size_t length;
+} VMConstant;
+
+typedef struct
+{
+    uint32_t *code;
+    size_t code_size;
+    VMConstant *constants;
+    size_t constant_count;
+} BytecodeProgram;
+
+// 把AST翻译成字节码，内存从arena分配。调用了未定义的函数时返回NULL，错误写到diag
+BytecodeProgram *vm_compile(ASTNode **nodes, int count, Arena *arena, FILE *diag);
+// 执行字节码，输出经过缓冲写到fd。成功返回0
+int vm_run(const BytecodeProgram *program, int fd, FILE *diag);
+
+#endif
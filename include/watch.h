@@ -0,0 +1,11 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+#include "driver.h"
+
+// --watch：先完整编译一次，然后用inotify监视源文件，每次保存后增量重新编译。
+// 源码按第0列的function行切成片段，只重新解析内容变了的片段，
+// 只为变了的函数重新生成C代码。正常情况下不返回；无法监视文件时返回1
+int watch_file(const char *source_path, const char *output_name, const CompileOptions *options);
+
+#endif
@@ -0,0 +1,88 @@
+#include "arena.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_INITIAL_CHUNK (64 * 1024)
+#define ARENA_MAX_CHUNK (16 * 1024 * 1024)
+#define ARENA_ALIGN 16
+
+void arena_init(Arena *arena)
+{
+    arena_init_sized(arena, ARENA_INITIAL_CHUNK);
+}
+
+void arena_init_sized(Arena *arena, size_t first_chunk)
+{
+    arena->head = NULL;
+    arena->chunk_size = first_chunk > ARENA_ALIGN ? first_chunk : ARENA_ALIGN;
+    arena->alloc_count = 0;
+    arena->chunk_count = 0;
+    arena->bytes_used = 0;
+}
+
+static ArenaChunk *arena_new_chunk(Arena *arena, size_t min_size)
+{
+    size_t size = arena->chunk_size;
+    if (size < min_size)
+        size = min_size;
+
+    ArenaChunk *chunk = malloc(sizeof(ArenaChunk) + size);
+    if (!chunk)
+    {
+        fprintf(stderr, "Error: Out of memory (arena chunk of %zu bytes)\n", size);
+        exit(1);
+    }
+    chunk->size = size;
+    chunk->used = 0;
+    chunk->next = arena->head;
+    arena->head = chunk;
+    arena->chunk_count++;
+
+    // 块大小按倍数增长，减少大输入下的malloc次数
+    if (arena->chunk_size < ARENA_MAX_CHUNK)
+        arena->chunk_size *= 2;
+    return chunk;
+}
+
+void *arena_alloc(Arena *arena, size_t size)
+{
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    if (size == 0)
+        size = ARENA_ALIGN;
+
+    ArenaChunk *chunk = arena->head;
+    if (!chunk || chunk->size - chunk->used < size)
+        chunk = arena_new_chunk(arena, size);
+
+    void *ptr = chunk->data + chunk->used;
+    chunk->used += size;
+    arena->alloc_count++;
+    arena->bytes_used += size;
+    return ptr;
+}
+
+char *arena_strndup(Arena *arena, const char *str, size_t len)
+{
+    char *copy = arena_alloc(arena, len + 1);
+    memcpy(copy, str, len);
+    copy[len] = '\0';
+    return copy;
+}
+
+char *arena_strdup(Arena *arena, const char *str)
+{
+    return arena_strndup(arena, str, strlen(str));
+}
+
+void arena_free(Arena *arena)
+{
+    ArenaChunk *chunk = arena->head;
+    while (chunk)
+    {
+        ArenaChunk *next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    arena->head = NULL;
+}
@@ -1,21 +1,23 @@
 #include "ast.h"
-#include <stdlib.h>
-#include <string.h>
 
-ASTNode *create_say_node(char *str)
+ASTNode *create_say_node(Arena *arena, const char *str, size_t length)
 {
-    ASTNode *node = malloc(sizeof(ASTNode));
+    ASTNode *node = arena_alloc(arena, sizeof(ASTNode));
     node->type = STMT_SAY;
-    node->value = strdup(str);
+    node->value = str;
+    node->length = length;
+    node->body = NULL;
+    node->body_count = 0;
     return node;
 }
 
-ASTNode *create_function_def_node(char *name, ASTNode **body, int body_count)
+ASTNode *create_function_def_node(Arena *arena, const char *name, size_t length, ASTNode **body, int body_count)
 {
-    ASTNode *node = malloc(sizeof(ASTNode));
+    ASTNode *node = arena_alloc(arena, sizeof(ASTNode));
     node->type = STMT_FUNCTION_DEF;
-    node->value = strdup(name);
-    node->body = malloc(sizeof(ASTNode *) * body_count);
+    node->value = name;
+    node->length = length;
+    node->body = arena_alloc(arena, sizeof(ASTNode *) * body_count);
     node->body_count = body_count;
 
     for (int i = 0; i < body_count; i++)
@@ -26,21 +28,13 @@ ASTNode *create_function_def_node(char *name, ASTNode **body, int body_count)
     return node;
 }
 
-ASTNode *create_function_call_node(char *name)
+ASTNode *create_function_call_node(Arena *arena, const char *name, size_t length)
 {
-    ASTNode *node = malloc(sizeof(ASTNode));
+    ASTNode *node = arena_alloc(arena, sizeof(ASTNode));
     node->type = STMT_FUNCTION_CALL;
-    node->value = strdup(name);
+    node->value = name;
+    node->length = length;
     node->body = NULL;
     node->body_count = 0;
     return node;
 }
-
-void free_node(ASTNode *node)
-{
-    if (node)
-    {
-        free(node->value);
-        free(node);
-    }
-}
\ No newline at end of file
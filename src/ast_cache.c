@@ -0,0 +1,131 @@
+#include "ast_cache.h"
+#include <stdlib.h>
+#include <string.h>
+
+void ast_cache_init(AstCache *cache, int max_entries)
+{
+    pthread_mutex_init(&cache->lock, NULL);
+    cache->head = NULL;
+    cache->count = 0;
+    cache->max_entries = max_entries > 0 ? max_entries : AST_CACHE_DEFAULT_ENTRIES;
+    cache->hits = 0;
+    cache->misses = 0;
+}
+
+static void free_entry(AstCacheEntry *entry)
+{
+    arena_free(&entry->arena);
+    source_unload(&entry->source);
+    free(entry->path);
+    free(entry);
+}
+
+// 从链表中移除（调用者持有锁）；没有人在用时立即释放
+static void evict_entry(AstCache *cache, AstCacheEntry **link)
+{
+    AstCacheEntry *entry = *link;
+    *link = entry->next;
+    cache->count--;
+    entry->evicted = 1;
+    if (entry->refs == 0)
+        free_entry(entry);
+}
+
+void ast_cache_destroy(AstCache *cache)
+{
+    while (cache->head)
+        evict_entry(cache, &cache->head);
+    pthread_mutex_destroy(&cache->lock);
+}
+
+void ast_cache_hash(const char *source, size_t length, char hash[SHA256_HEX_SIZE])
+{
+    Sha256 ctx;
+    sha256_init(&ctx);
+    sha256_update(&ctx, source, length);
+    sha256_final_hex(&ctx, hash);
+}
+
+AstCacheEntry *ast_cache_acquire(AstCache *cache, const char *path, const char *hash, OptLevel opt_level)
+{
+    pthread_mutex_lock(&cache->lock);
+    AstCacheEntry **link = &cache->head;
+    while (*link)
+    {
+        AstCacheEntry *entry = *link;
+        if (entry->opt_level == opt_level && strcmp(entry->path, path) == 0 &&
+            strcmp(entry->hash, hash) == 0)
+        {
+            // 移到链表头
+            *link = entry->next;
+            entry->next = cache->head;
+            cache->head = entry;
+            entry->refs++;
+            cache->hits++;
+            pthread_mutex_unlock(&cache->lock);
+            return entry;
+        }
+        link = &entry->next;
+    }
+    cache->misses++;
+    pthread_mutex_unlock(&cache->lock);
+    return NULL;
+}
+
+void ast_cache_release(AstCache *cache, AstCacheEntry *entry)
+{
+    pthread_mutex_lock(&cache->lock);
+    int release = --entry->refs == 0 && entry->evicted;
+    pthread_mutex_unlock(&cache->lock);
+    if (release)
+        free_entry(entry);
+}
+
+void ast_cache_insert(AstCache *cache, const char *path, const char *hash, OptLevel opt_level,
+                      SourceFile *source, const char *c_header, Arena *arena, ASTNode **nodes, int count)
+{
+    AstCacheEntry *entry = calloc(1, sizeof(AstCacheEntry));
+    char *path_copy = strdup(path);
+    if (!entry || !path_copy)
+    {
+        free(entry);
+        free(path_copy);
+        arena_free(arena);
+        source_unload(source);
+        return;
+    }
+    entry->path = path_copy;
+    memcpy(entry->hash, hash, SHA256_HEX_SIZE);
+    entry->opt_level = opt_level;
+    entry->source = *source;
+    memset(source, 0, sizeof(*source));
+    entry->c_header = c_header;
+    entry->arena = *arena;
+    memset(arena, 0, sizeof(*arena));
+    entry->nodes = nodes;
+    entry->count = count;
+
+    pthread_mutex_lock(&cache->lock);
+    // 同一路径同一优化级别只保留最新的内容
+    AstCacheEntry **link = &cache->head;
+    while (*link)
+    {
+        if ((*link)->opt_level == opt_level && strcmp((*link)->path, path) == 0)
+            evict_entry(cache, link);
+        else
+            link = &(*link)->next;
+    }
+    entry->next = cache->head;
+    cache->head = entry;
+    cache->count++;
+
+    // 超过容量时淘汰链表尾部最久未用的条目
+    while (cache->count > cache->max_entries)
+    {
+        link = &cache->head;
+        while ((*link)->next)
+            link = &(*link)->next;
+        evict_entry(cache, link);
+    }
+    pthread_mutex_unlock(&cache->lock);
+}
@@ -0,0 +1,134 @@
+#include "batch.h"
+#include "threadpool.h"
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct BatchItem
+{
+    char *source;
+    char *output;
+    int status;
+    const CompileOptions *options;
+} BatchItem;
+
+static pthread_mutex_t diag_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static void batch_compile_one(void *arg)
+{
+    BatchItem *item = arg;
+
+    // 每个文件的诊断信息先写进内存，编译结束后整体输出
+    char *text = NULL;
+    size_t size = 0;
+    FILE *diag = open_memstream(&text, &size);
+    if (!diag)
+    {
+        item->status = compile_file(item->source, item->output, item->options, stderr);
+        return;
+    }
+    item->status = compile_file(item->source, item->output, item->options, diag);
+    fclose(diag);
+
+    if (size > 0)
+    {
+        pthread_mutex_lock(&diag_lock);
+        fwrite(text, 1, size, stderr);
+        fflush(stderr);
+        pthread_mutex_unlock(&diag_lock);
+    }
+    free(text);
+}
+
+static char *default_output(const char *source)
+{
+    size_t len = strlen(source);
+    const char *ext = ".hercode";
+    size_t ext_len = strlen(ext);
+    char *output = malloc(len + 5);
+    if (!output)
+        return NULL;
+    if (len > ext_len && strcmp(source + len - ext_len, ext) == 0)
+    {
+        memcpy(output, source, len - ext_len);
+        output[len - ext_len] = '\0';
+    }
+    else
+        sprintf(output, "%s.out", source);
+    return output;
+}
+
+// 读取清单，返回任务数组（调用者释放），出错返回NULL
+static BatchItem *read_manifest(const char *manifest_path, int *count)
+{
+    FILE *file = fopen(manifest_path, "r");
+    if (!file)
+    {
+        fprintf(stderr, "Error reading manifest %s: %s\n", manifest_path, strerror(errno));
+        return NULL;
+    }
+
+    int capacity = 16;
+    BatchItem *items = malloc(capacity * sizeof(BatchItem));
+    *count = 0;
+    char *line = NULL;
+    size_t line_size = 0;
+    while (items && getline(&line, &line_size, file) != -1)
+    {
+        char *save = NULL;
+        char *source = strtok_r(line, " \t\r\n", &save);
+        if (!source || source[0] == '#')
+            continue;
+        char *output = strtok_r(NULL, " \t\r\n", &save);
+
+        if (*count == capacity)
+        {
+            capacity *= 2;
+            BatchItem *grown = realloc(items, capacity * sizeof(BatchItem));
+            if (!grown)
+                break;
+            items = grown;
+        }
+        BatchItem *item = &items[(*count)++];
+        item->source = strdup(source);
+        item->output = output ? strdup(output) : default_output(source);
+        item->status = 1;
+    }
+    free(line);
+    fclose(file);
+    return items;
+}
+
+int compile_batch(const char *manifest_path, int jobs, const CompileOptions *options)
+{
+    int count;
+    BatchItem *items = read_manifest(manifest_path, &count);
+    if (!items)
+        return 1;
+
+    if (jobs > count)
+        jobs = count > 0 ? count : 1;
+    ThreadPool *pool = threadpool_create(jobs);
+    for (int i = 0; i < count; i++)
+    {
+        items[i].options = options;
+        threadpool_submit(pool, batch_compile_one, &items[i]);
+    }
+    threadpool_wait(pool);
+    threadpool_destroy(pool);
+
+    int failed = 0;
+    for (int i = 0; i < count; i++)
+    {
+        if (items[i].status != 0)
+            failed++;
+        free(items[i].source);
+        free(items[i].output);
+    }
+    free(items);
+
+    if (failed)
+        fprintf(stderr, "batch: %d of %d files failed\n", failed, count);
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,358 @@
+#include "cache.h"
+#include "toolchain.h"
+#include "trace.h"
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+typedef enum
+{
+    STAT_HITS,
+    STAT_MISSES,
+    STAT_STORES,
+    STAT_EVICTIONS,
+    STAT_COUNT
+} CacheStat;
+
+static const char *const stat_names[STAT_COUNT] = {"hits", "misses", "stores", "evictions"};
+
+// 相当于mkdir -p
+static int make_dirs(const char *path)
+{
+    char buffer[PATH_MAX];
+    size_t len = strlen(path);
+    if (len >= sizeof(buffer))
+        return -1;
+    memcpy(buffer, path, len + 1);
+    for (char *p = buffer + 1; *p; p++)
+    {
+        if (*p != '/')
+            continue;
+        *p = '\0';
+        if (mkdir(buffer, 0755) != 0 && errno != EEXIST)
+            return -1;
+        *p = '/';
+    }
+    if (mkdir(buffer, 0755) != 0 && errno != EEXIST)
+        return -1;
+    return 0;
+}
+
+int cache_open(BuildCache *cache, const char *dir, unsigned long long max_bytes)
+{
+    const char *env;
+    int n;
+    if (dir)
+        n = snprintf(cache->dir, sizeof(cache->dir), "%s", dir);
+    else if ((env = getenv("HERCODE_CACHE_DIR")) && *env)
+        n = snprintf(cache->dir, sizeof(cache->dir), "%s", env);
+    else if ((env = getenv("XDG_CACHE_HOME")) && *env)
+        n = snprintf(cache->dir, sizeof(cache->dir), "%s/hercode", env);
+    else if ((env = getenv("HOME")) && *env)
+        n = snprintf(cache->dir, sizeof(cache->dir), "%s/.cache/hercode", env);
+    else
+        return -1;
+    if (n < 0 || (size_t)n >= sizeof(cache->dir))
+        return -1;
+    cache->max_bytes = max_bytes;
+
+    char bin_dir[PATH_MAX + 8];
+    snprintf(bin_dir, sizeof(bin_dir), "%s/bin", cache->dir);
+    if (make_dirs(bin_dir) != 0)
+    {
+        fprintf(stderr, "Warning: cannot create cache directory %s: %s\n", bin_dir, strerror(errno));
+        return -1;
+    }
+    return 0;
+}
+
+// 在stats文件上加锁后更新计数器，多个编译进程可以同时使用同一个缓存
+static void cache_bump(BuildCache *cache, CacheStat stat, unsigned long long amount)
+{
+    char path[PATH_MAX + 8];
+    snprintf(path, sizeof(path), "%s/stats", cache->dir);
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return;
+    flock(fd, LOCK_EX);
+
+    unsigned long long values[STAT_COUNT] = {0};
+    char text[256];
+    ssize_t n = pread(fd, text, sizeof(text) - 1, 0);
+    if (n > 0)
+    {
+        text[n] = '\0';
+        for (int i = 0; i < STAT_COUNT; i++)
+        {
+            char *line = strstr(text, stat_names[i]);
+            if (line)
+                values[i] = strtoull(line + strlen(stat_names[i]), NULL, 10);
+        }
+    }
+    values[stat] += amount;
+
+    int len = 0;
+    for (int i = 0; i < STAT_COUNT; i++)
+        len += snprintf(text + len, sizeof(text) - len, "%s %llu\n", stat_names[i], values[i]);
+    if (ftruncate(fd, 0) == 0 && pwrite(fd, text, len, 0) != len)
+        TRACE(TRACE_DRIVER, "Failed to update cache stats");
+    flock(fd, LOCK_UN);
+    close(fd);
+}
+
+int cache_compute_key(const char *hercode_source, const char *c_header, const char *flags,
+                      char key[SHA256_HEX_SIZE])
+{
+    char version[1024];
+    if (cc_version(version, sizeof(version)) != 0)
+        return -1;
+
+    Sha256 ctx;
+    sha256_init(&ctx);
+    sha256_update(&ctx, "hercode-cache-1", 16);
+    sha256_update(&ctx, version, strlen(version) + 1);
+    sha256_update(&ctx, flags, strlen(flags) + 1);
+
+    // 编译器本身更新后旧的缓存条目不再可信
+    struct stat self;
+    if (stat("/proc/self/exe", &self) == 0)
+    {
+        unsigned long long identity[2] = {(unsigned long long)self.st_size,
+                                          (unsigned long long)self.st_mtime};
+        sha256_update(&ctx, identity, sizeof(identity));
+    }
+
+    // 区分"没有C头"和"空C头"
+    sha256_update(&ctx, c_header ? "H" : "N", 1);
+    if (c_header)
+        sha256_update(&ctx, c_header, strlen(c_header) + 1);
+    sha256_update(&ctx, hercode_source, strlen(hercode_source));
+    sha256_final_hex(&ctx, key);
+    return 0;
+}
+
+// 把from的内容写到已打开的out，并关闭out
+static int copy_to_fd(const char *from, int out)
+{
+    int in = open(from, O_RDONLY | O_CLOEXEC);
+    if (in < 0)
+    {
+        close(out);
+        return -1;
+    }
+
+    char buffer[65536];
+    int result = 0;
+    for (;;)
+    {
+        ssize_t n = read(in, buffer, sizeof(buffer));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+            result = -1;
+        if (n <= 0)
+            break;
+        for (ssize_t done = 0; done < n;)
+        {
+            ssize_t w = write(out, buffer + done, n - done);
+            if (w < 0 && errno == EINTR)
+                continue;
+            if (w < 0)
+            {
+                result = -1;
+                break;
+            }
+            done += w;
+        }
+        if (result != 0)
+            break;
+    }
+    close(in);
+    if (close(out) != 0)
+        result = -1;
+    return result;
+}
+
+static int copy_file(const char *from, const char *to)
+{
+    int out = open(to, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0755);
+    if (out < 0)
+        return -1;
+    return copy_to_fd(from, out);
+}
+
+int cache_lookup(BuildCache *cache, const char *key, const char *output_path)
+{
+    char entry[PATH_MAX + 80];
+    snprintf(entry, sizeof(entry), "%s/bin/%s", cache->dir, key);
+    if (access(entry, F_OK) != 0)
+    {
+        cache_bump(cache, STAT_MISSES, 1);
+        return 0;
+    }
+
+    // 优先硬链接；跨文件系统时退回到复制
+    unlink(output_path);
+    if (link(entry, output_path) != 0 && copy_file(entry, output_path) != 0)
+    {
+        TRACE(TRACE_DRIVER, "Cache entry %s could not be copied to %s", key, output_path);
+        cache_bump(cache, STAT_MISSES, 1);
+        return 0;
+    }
+
+    // 更新修改时间，作为LRU淘汰的依据
+    utimensat(AT_FDCWD, entry, NULL, 0);
+    cache_bump(cache, STAT_HITS, 1);
+    TRACE(TRACE_DRIVER, "Cache hit %s", key);
+    return 1;
+}
+
+typedef struct
+{
+    char name[SHA256_HEX_SIZE + 32];
+    time_t mtime;
+    unsigned long long size;
+} CacheEntry;
+
+static int compare_entries(const void *a, const void *b)
+{
+    const CacheEntry *x = a, *y = b;
+    return (x->mtime > y->mtime) - (x->mtime < y->mtime);
+}
+
+// 扫描bin目录，返回条目列表（调用者free）
+static CacheEntry *list_entries(BuildCache *cache, size_t *count, unsigned long long *total)
+{
+    char bin_dir[PATH_MAX + 8];
+    snprintf(bin_dir, sizeof(bin_dir), "%s/bin", cache->dir);
+    *count = 0;
+    *total = 0;
+    DIR *dir = opendir(bin_dir);
+    if (!dir)
+        return NULL;
+
+    size_t capacity = 64;
+    CacheEntry *entries = malloc(capacity * sizeof(CacheEntry));
+    struct dirent *ent;
+    while (entries && (ent = readdir(dir)) != NULL)
+    {
+        struct stat st;
+        if (ent->d_name[0] == '.' || strlen(ent->d_name) >= sizeof(entries[0].name))
+            continue;
+        if (fstatat(dirfd(dir), ent->d_name, &st, 0) != 0 || !S_ISREG(st.st_mode))
+            continue;
+        if (*count == capacity)
+        {
+            capacity *= 2;
+            CacheEntry *grown = realloc(entries, capacity * sizeof(CacheEntry));
+            if (!grown)
+                break;
+            entries = grown;
+        }
+        strcpy(entries[*count].name, ent->d_name);
+        entries[*count].mtime = st.st_mtime;
+        entries[*count].size = (unsigned long long)st.st_size;
+        *total += entries[*count].size;
+        (*count)++;
+    }
+    closedir(dir);
+    return entries;
+}
+
+static void cache_evict(BuildCache *cache, const char *keep)
+{
+    size_t count;
+    unsigned long long total;
+    CacheEntry *entries = list_entries(cache, &count, &total);
+    if (!entries)
+        return;
+
+    if (total > cache->max_bytes)
+    {
+        qsort(entries, count, sizeof(CacheEntry), compare_entries);
+        unsigned long long evicted = 0;
+        for (size_t i = 0; i < count && total > cache->max_bytes; i++)
+        {
+            if (strcmp(entries[i].name, keep) == 0)
+                continue;
+            char path[PATH_MAX + 80];
+            snprintf(path, sizeof(path), "%s/bin/%s", cache->dir, entries[i].name);
+            if (unlink(path) == 0)
+            {
+                total -= entries[i].size;
+                evicted++;
+                TRACE(TRACE_DRIVER, "Evicted cache entry %s", entries[i].name);
+            }
+        }
+        if (evicted)
+            cache_bump(cache, STAT_EVICTIONS, evicted);
+    }
+    free(entries);
+}
+
+int cache_store(BuildCache *cache, const char *key, const char *output_path)
+{
+    // 先复制到临时文件再rename，并发的编译不会看到写了一半的条目
+    char entry[PATH_MAX + 80], temp[PATH_MAX + 120];
+    snprintf(entry, sizeof(entry), "%s/bin/%s", cache->dir, key);
+    snprintf(temp, sizeof(temp), "%s/bin/.%s.XXXXXX", cache->dir, key);
+    int fd = mkstemp(temp);
+    if (fd < 0)
+        return -1;
+    if (fchmod(fd, 0755) != 0)
+    {
+        close(fd);
+        unlink(temp);
+        return -1;
+    }
+    if (copy_to_fd(output_path, fd) != 0 || rename(temp, entry) != 0)
+    {
+        unlink(temp);
+        TRACE(TRACE_DRIVER, "Failed to store %s in the cache", output_path);
+        return -1;
+    }
+    cache_bump(cache, STAT_STORES, 1);
+    cache_evict(cache, key);
+    return 0;
+}
+
+void cache_print_stats(BuildCache *cache, FILE *out)
+{
+    size_t count;
+    unsigned long long total;
+    free(list_entries(cache, &count, &total));
+
+    unsigned long long values[STAT_COUNT] = {0};
+    char path[PATH_MAX + 8];
+    snprintf(path, sizeof(path), "%s/stats", cache->dir);
+    FILE *file = fopen(path, "r");
+    if (file)
+    {
+        char name[32];
+        unsigned long long value;
+        while (fscanf(file, "%31s %llu", name, &value) == 2)
+        {
+            for (int i = 0; i < STAT_COUNT; i++)
+            {
+                if (strcmp(name, stat_names[i]) == 0)
+                    values[i] = value;
+            }
+        }
+        fclose(file);
+    }
+
+    unsigned long long lookups = values[STAT_HITS] + values[STAT_MISSES];
+    fprintf(out, "cache directory: %s\n", cache->dir);
+    fprintf(out, "entries:         %zu\n", count);
+    fprintf(out, "size:            %.2f / %.2f MiB\n", total / 1048576.0, cache->max_bytes / 1048576.0);
+    fprintf(out, "hits:            %llu\n", values[STAT_HITS]);
+    fprintf(out, "misses:          %llu\n", values[STAT_MISSES]);
+    fprintf(out, "hit rate:        %.1f%%\n", lookups ? 100.0 * values[STAT_HITS] / lookups : 0.0);
+    fprintf(out, "stores:          %llu\n", values[STAT_STORES]);
+    fprintf(out, "evictions:       %llu\n", values[STAT_EVICTIONS]);
+}
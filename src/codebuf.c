@@ -0,0 +1,201 @@
+#include "codebuf.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#define CODEBUF_MIN_CAPACITY 256
+
+void codebuf_init(CodeBuffer *buffer, size_t capacity)
+{
+    buffer->capacity = capacity < CODEBUF_MIN_CAPACITY ? CODEBUF_MIN_CAPACITY : capacity;
+    buffer->data = malloc(buffer->capacity);
+    buffer->length = 0;
+    buffer->failed = buffer->data == NULL;
+    if (buffer->failed)
+        buffer->capacity = 0;
+}
+
+void codebuf_free(CodeBuffer *buffer)
+{
+    free(buffer->data);
+    buffer->data = NULL;
+    buffer->length = 0;
+    buffer->capacity = 0;
+}
+
+// 保证还能追加extra字节；失败时标记缓冲区并返回-1
+static int reserve(CodeBuffer *buffer, size_t extra)
+{
+    if (buffer->failed)
+        return -1;
+    if (buffer->length + extra <= buffer->capacity)
+        return 0;
+    size_t capacity = buffer->capacity ? buffer->capacity : CODEBUF_MIN_CAPACITY;
+    while (capacity < buffer->length + extra)
+        capacity *= 2;
+    char *data = realloc(buffer->data, capacity);
+    if (!data)
+    {
+        buffer->failed = 1;
+        return -1;
+    }
+    buffer->data = data;
+    buffer->capacity = capacity;
+    return 0;
+}
+
+void codebuf_append(CodeBuffer *buffer, const char *data, size_t length)
+{
+    if (reserve(buffer, length) != 0)
+        return;
+    memcpy(buffer->data + buffer->length, data, length);
+    buffer->length += length;
+}
+
+void codebuf_append_range(CodeBuffer *buffer, size_t offset, size_t length)
+{
+    if (reserve(buffer, length) != 0)
+        return;
+    memcpy(buffer->data + buffer->length, buffer->data + offset, length);
+    buffer->length += length;
+}
+
+void codebuf_append_char(CodeBuffer *buffer, char c)
+{
+    if (reserve(buffer, 1) != 0)
+        return;
+    buffer->data[buffer->length++] = c;
+}
+
+void codebuf_append_size(CodeBuffer *buffer, size_t value)
+{
+    char digits[24];
+    int n = sizeof(digits);
+    do
+    {
+        digits[--n] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value);
+    codebuf_append(buffer, digits + n, sizeof(digits) - n);
+}
+
+void codebuf_append_identifier(CodeBuffer *buffer, const char *prefix, const char *name, size_t length)
+{
+    size_t prefix_length = strlen(prefix);
+    if (reserve(buffer, prefix_length + length) != 0)
+        return;
+    memcpy(buffer->data + buffer->length, prefix, prefix_length);
+    memcpy(buffer->data + buffer->length + prefix_length, name, length);
+    buffer->length += prefix_length + length;
+}
+
+static int needs_escape(unsigned char c)
+{
+    return c < 0x20 || c == 0x7f || c == '\\' || c == '"' || c == '?';
+}
+
+void codebuf_append_escaped(CodeBuffer *buffer, const char *str, size_t length)
+{
+    // 最坏情况每个字节变成4个字符（八进制转义），先一次性留够空间
+    if (reserve(buffer, length * 4) != 0)
+        return;
+    char *out = buffer->data + buffer->length;
+    for (size_t i = 0; i < length; i++)
+    {
+        // 不需要转义的一段整体复制
+        size_t run = i;
+        while (run < length && !needs_escape((unsigned char)str[run]))
+            run++;
+        memcpy(out, str + i, run - i);
+        out += run - i;
+        if (run == length)
+            break;
+        i = run;
+
+        unsigned char c = (unsigned char)str[i];
+        switch (c)
+        {
+        case '\\':
+        case '"':
+            *out++ = '\\';
+            *out++ = (char)c;
+            break;
+        case '\n':
+            *out++ = '\\';
+            *out++ = 'n';
+            break;
+        case '\r':
+            *out++ = '\\';
+            *out++ = 'r';
+            break;
+        case '\t':
+            *out++ = '\\';
+            *out++ = 't';
+            break;
+        case '?':
+            // "??"后面跟某些字符是三字符组，在-std=c99等模式下会被替换
+            *out++ = '?';
+            if (i + 1 < length && str[i + 1] == '?')
+                *out++ = '\\';
+            break;
+        default:
+            if (c < 0x20 || c == 0x7f)
+            {
+                // 其他控制字符用八进制转义
+                *out++ = '\\';
+                *out++ = (char)('0' + (c >> 6));
+                *out++ = (char)('0' + ((c >> 3) & 7));
+                *out++ = (char)('0' + (c & 7));
+            }
+            else
+                *out++ = (char)c;
+        }
+    }
+    buffer->length = out - buffer->data;
+}
+
+int codebuf_write(const CodeBuffer *buffer, int fd)
+{
+    CodeBuffer *buffers[] = {(CodeBuffer *)buffer};
+    return codebuf_writev(buffers, 1, fd);
+}
+
+int codebuf_writev(CodeBuffer *const *buffers, int count, int fd)
+{
+    struct iovec iov[64];
+    int next = 0;       // 下一个要放进iov的缓冲区
+    size_t skipped = 0; // buffers[next]已经写出的字节数（上一次部分写入）
+    for (int i = 0; i < count; i++)
+    {
+        if (buffers[i]->failed)
+            return -1;
+    }
+    while (next < count)
+    {
+        int n = 0;
+        for (int i = next; i < count && n < (int)(sizeof(iov) / sizeof(iov[0])); i++)
+        {
+            size_t offset = i == next ? skipped : 0;
+            iov[n].iov_base = buffers[i]->data + offset;
+            iov[n].iov_len = buffers[i]->length - offset;
+            n++;
+        }
+        ssize_t written = writev(fd, iov, n);
+        if (written < 0 && errno == EINTR)
+            continue;
+        if (written < 0)
+            return -1;
+        // 跳过已经写完的缓冲区
+        size_t remaining = written;
+        while (next < count && remaining >= buffers[next]->length - skipped)
+        {
+            remaining -= buffers[next]->length - skipped;
+            skipped = 0;
+            next++;
+        }
+        skipped += remaining;
+    }
+    return 0;
+}
@@ -1,146 +1,248 @@
 #include "codegen.h"
+#include "threadpool.h"
+#include "toolchain.h"
+#include "trace.h"
+#include <stdatomic.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-static FunctionDef **global_functions = NULL;
-static int global_function_count = 0;
 
-// 字符串转义函数
-char *escape_string(const char *input)
+void build_function_table(FunctionTable *table, ASTNode **nodes, int count, Arena *arena)
 {
-    if (!input)
-        return strdup("");
-
-    // 计算需要多少额外空间
-    size_t len = strlen(input);
-    size_t extra = 0;
-    for (const char *c = input; *c; c++)
+    table->defs = arena_alloc(arena, (count + 1) * sizeof(FunctionDef));
+    table->count = 0;
+    symtab_init(&table->symbols, arena, count);
+    for (int i = 0; i < count; i++)
     {
-        if (*c == '\\' || *c == '"')
-            extra++;
+        if (nodes[i]->type != STMT_FUNCTION_DEF)
+            continue;
+        Symbol *symbol = symtab_intern(&table->symbols, nodes[i]->value, nodes[i]->length);
+        if (symbol->value)
+            continue;
+        FunctionDef *def = &table->defs[table->count++];
+        def->name = nodes[i]->value;
+        def->name_length = nodes[i]->length;
+        def->body = nodes[i]->body;
+        def->body_count = nodes[i]->body_count;
+        symbol->value = def;
     }
+}
 
-    // 分配内存
-    char *output = malloc(len + extra + 1);
-    if (!output)
-        return NULL;
+FunctionDef *find_function(const FunctionTable *table, const char *name, size_t length)
+{
+    Symbol *symbol = symtab_lookup(&table->symbols, name, length);
+    return symbol ? symbol->value : NULL;
+}
 
-    char *dst = output;
-    for (const char *src = input; *src; src++)
+// 生成一串语句。连续的say拼成一个字符串字面量，用一次fwrite输出，
+// 生成的程序不用为每句话解析一次printf的格式串
+static void write_statements(CodeBuffer *output, ASTNode **stmts, int count)
+{
+    for (int i = 0; i < count;)
     {
-        if (*src == '\\' || *src == '"')
+        if (stmts[i]->type == STMT_SAY)
         {
-            *dst++ = '\\'; // 添加转义字符
+            size_t length = 0;
+            codebuf_append_literal(output, "    fwrite(");
+            for (int first = i; i < count && stmts[i]->type == STMT_SAY; i++)
+            {
+                // 每句话单独占一行，相邻的字面量由C编译器拼接
+                if (i > first)
+                    codebuf_append_literal(output, "\n           ");
+                codebuf_append_char(output, '"');
+                codebuf_append_escaped(output, stmts[i]->value, stmts[i]->length);
+                codebuf_append_literal(output, "\\n\"");
+                length += stmts[i]->length + 1;
+            }
+            codebuf_append_literal(output, ", 1, ");
+            codebuf_append_size(output, length);
+            codebuf_append_literal(output, ", stdout);\n");
+            continue;
         }
-        *dst++ = *src;
+        if (stmts[i]->type == STMT_FUNCTION_CALL)
+        {
+            codebuf_append_identifier(output, "    function_", stmts[i]->value, stmts[i]->length);
+            codebuf_append_literal(output, "();\n");
+        }
+        i++;
     }
-    *dst = '\0';
-    return output;
 }
 
-void generate_c_code(const char *c_header, ASTNode **nodes, int count, FILE *output)
+void write_function_declaration(CodeBuffer *output, const FunctionDef *def)
 {
-    // 写入C头文件部分
-    fprintf(output, "#include <stdio.h>\n");
-    fprintf(output, "#include <stdlib.h>\n");
-    fprintf(output, "#include <string.h>\n");
-    fprintf(output, "#include <math.h>\n");
-    fprintf(output, "#include <time.h>\n");
-    fprintf(output, "#include <ctype.h>\n");
-    fprintf(output, "#include <float.h>\n");
-    fprintf(output, "#include <assert.h>\n");
-    fprintf(output, "#include <errno.h>\n");
-    fprintf(output, "#include <stddef.h>\n");
-    fprintf(output, "#include <signal.h>\n");
-    fprintf(output, "#include <setjmp.h>\n");
-    fprintf(output, "#include <locale.h>\n\n");
-
-    // 首先收集所有函数定义
-    global_functions = malloc(MAX_FUNCTIONS * sizeof(FunctionDef *));
-    for (int i = 0; i < count; i++)
-    {
-        if (nodes[i]->type == STMT_FUNCTION_DEF)
-        {
-            FunctionDef *def = malloc(sizeof(FunctionDef));
-            def->name = strdup(nodes[i]->value);
-            def->body = nodes[i]->body;
-            def->body_count = nodes[i]->body_count;
-
-            global_functions[global_function_count++] = def;
-        }
-    }
+    codebuf_append_identifier(output, "void function_", def->name, def->name_length);
+    codebuf_append_literal(output, "();\n");
+}
 
-    // 生成函数声明（所有函数都返回void）
-    fprintf(output, "\n/* Function declarations */\n");
-    for (int i = 0; i < global_function_count; i++)
-        fprintf(output, "void function_%s();\n", global_functions[i]->name);
-    // 生成main函数
-    fprintf(output, "\nint main() {\n");
-    // 如果有外部C代码头文件，写入它
+void write_main_function(CodeBuffer *output, const char *c_header, ASTNode **nodes, int count)
+{
+    codebuf_append_literal(output, "\nint main() {\n");
+    // 纯HerCode程序只往stdout写，用大的全缓冲减少write调用；
+    // 带C头的程序可能和stdin交互，保持默认的缓冲方式
+    if (c_header == NULL)
+        codebuf_append_literal(output, "    setvbuf(stdout, NULL, _IOFBF, 1 << 16);\n");
+    // 如果有外部C代码头文件，逐行缩进后写入
     if (c_header != NULL)
     {
-        // 逐行处理 c_header
         const char *start = c_header;
         const char *end;
         while ((end = strchr(start, '\n')) != NULL)
-        { // 找到换行符
-            // 输出：制表符 + 当前行（不含换行符）
-            fprintf(output, "\t%.*s\n", (int)(end - start), start);
+        {
+            codebuf_append_char(output, '\t');
+            codebuf_append(output, start, end - start + 1);
             start = end + 1; // 移到下一行
         }
         // 输出剩余部分（最后一行）
         if (*start != '\0')
         {
-            fprintf(output, "\t%s\n", start);
+            codebuf_append_char(output, '\t');
+            codebuf_append(output, start, strlen(start));
+            codebuf_append_char(output, '\n');
         }
     }
-    for (int i = 0; i < count; i++)
+    write_statements(output, nodes, count);
+    codebuf_append_literal(output, "    return 0;\n}\n");
+}
+
+void write_function_definition(CodeBuffer *output, const FunctionDef *def)
+{
+    codebuf_append_identifier(output, "void function_", def->name, def->name_length);
+    codebuf_append_literal(output, "() {\n");
+
+    write_statements(output, def->body, def->body_count);
+
+    codebuf_append_literal(output, "}\n\n");
+}
+
+// 并行生成函数实现：函数按定义顺序切成固定大小的块，每块写进自己的缓冲区，
+// 工作线程从共享的计数器领取下一块，先做完的线程自动多领，负载就均衡了
+typedef struct
+{
+    const FunctionDef *functions;
+    int function_count;
+    CodeBuffer *chunks;
+    int chunk_count;
+    atomic_int next_chunk;
+} ParallelCodegen;
+
+static void generate_chunks(void *arg)
+{
+    ParallelCodegen *work = arg;
+    int chunk;
+    while ((chunk = atomic_fetch_add(&work->next_chunk, 1)) < work->chunk_count)
     {
-        if (nodes[i]->type == STMT_SAY)
-            fprintf(output, "    printf(\"%%s\\n\", \"%s\");\n", nodes[i]->value);
-        else if (nodes[i]->type == STMT_FUNCTION_CALL)
-            fprintf(output, "    function_%s();\n", nodes[i]->value);
+        int first = chunk * CODEGEN_CHUNK_FUNCTIONS;
+        int last = first + CODEGEN_CHUNK_FUNCTIONS;
+        if (last > work->function_count)
+            last = work->function_count;
+        codebuf_init(&work->chunks[chunk], (size_t)(last - first) * 256);
+        for (int i = first; i < last; i++)
+            write_function_definition(&work->chunks[chunk], &work->functions[i]);
     }
-    fprintf(output, "    return 0;\n}\n");
+}
 
-    // 生成函数实现
-    fprintf(output, "\n/* Function implementations */\n");
-    for (int i = 0; i < global_function_count; i++)
+// 按块的顺序拼接，结果和串行生成逐字节相同
+static void write_function_definitions(CodeBuffer *output, const FunctionDef *functions, int function_count,
+                                       int jobs, Arena *arena)
+{
+    if (jobs <= 1 || function_count < CODEGEN_PARALLEL_MIN_FUNCTIONS)
     {
-        FunctionDef *def = global_functions[i];
-        fprintf(output, "void function_%s() {\n", def->name);
+        for (int i = 0; i < function_count; i++)
+            write_function_definition(output, &functions[i]);
+        return;
+    }
 
-        for (int j = 0; j < def->body_count; j++)
-        {
-            ASTNode *stmt = def->body[j];
+    ParallelCodegen work;
+    work.functions = functions;
+    work.function_count = function_count;
+    work.chunk_count = (function_count + CODEGEN_CHUNK_FUNCTIONS - 1) / CODEGEN_CHUNK_FUNCTIONS;
+    work.chunks = arena_alloc(arena, work.chunk_count * sizeof(CodeBuffer));
+    atomic_init(&work.next_chunk, 0);
+    if (jobs > work.chunk_count)
+        jobs = work.chunk_count;
 
-            if (stmt->type == STMT_SAY)
-            {
-                char *escaped = escape_string(stmt->value);
-                fprintf(output, "    printf(\"%%s\\n\", \"%s\");\n", escaped);
-                free(escaped);
-            }
-            else if (stmt->type == STMT_FUNCTION_CALL)
-            {
-                fprintf(output, "    function_%s();\n", stmt->value);
-            }
-        }
+    TRACE(TRACE_CODEGEN, "Generating %d functions in %d chunks on %d threads", function_count,
+          work.chunk_count, jobs);
+    ThreadPool *pool = threadpool_create(jobs);
+    for (int i = 0; i < jobs; i++)
+        threadpool_submit(pool, generate_chunks, &work);
+    threadpool_wait(pool);
+    threadpool_destroy(pool);
 
-        fprintf(output, "}\n\n");
+    for (int i = 0; i < work.chunk_count; i++)
+    {
+        if (work.chunks[i].failed)
+            output->failed = 1;
+        codebuf_append(output, work.chunks[i].data, work.chunks[i].length);
+        codebuf_free(&work.chunks[i]);
     }
+}
 
-    // 清理
-    for (int i = 0; i < global_function_count; i++)
+void generate_c_code(const char *c_header, ASTNode **nodes, int count, PreludeMode prelude, int jobs,
+                     CodeBuffer *output)
+{
+    // 写入C头文件部分
+    write_prelude(output, prelude, c_header);
+
+    // 首先收集所有函数定义（局部变量，多个线程可以同时生成代码）
+    Arena arena;
+    arena_init(&arena);
+    FunctionTable table;
+    build_function_table(&table, nodes, count, &arena);
+    FunctionDef *functions = table.defs;
+    int function_count = table.count;
+
+    TRACE(TRACE_CODEGEN, "%d top-level nodes, %d functions", count, function_count);
+
+    // 生成函数声明（所有函数都返回void）
+    codebuf_append_literal(output, "\n/* Function declarations */\n");
+    for (int i = 0; i < function_count; i++)
+        write_function_declaration(output, &functions[i]);
+    // 生成main函数
+    write_main_function(output, c_header, nodes, count);
+
+    // 生成函数实现
+    codebuf_append_literal(output, "\n/* Function implementations */\n");
+    write_function_definitions(output, functions, function_count, jobs, &arena);
+
+    arena_free(&arena);
+}
+
+void generate_constant_program(const char *data, size_t length, CodeBuffer *output)
+{
+    // 不需要prelude里的stdio，只用write
+    codebuf_append_literal(output, "#include <unistd.h>\n\nstatic const char output[] =\n");
+    if (length == 0)
+        codebuf_append_literal(output, "    \"\"");
+    // 每行输出写成一个字符串字面量，gcc把它们拼起来
+    for (size_t i = 0; i < length;)
     {
-        free(global_functions[i]);
+        const char *newline = memchr(data + i, '\n', length - i);
+        size_t end = newline ? (size_t)(newline - data) + 1 : length;
+        if (i)
+            codebuf_append_char(output, '\n');
+        codebuf_append_literal(output, "    \"");
+        codebuf_append_escaped(output, data + i, end - i);
+        codebuf_append_char(output, '"');
+        i = end;
     }
-    free(global_functions);
-    global_function_count = 0;
+    codebuf_append_literal(output, ";\n\n"
+                                   "int main() {\n"
+                                   "    const char *p = output;\n"
+                                   "    size_t n = sizeof(output) - 1;\n"
+                                   "    while (n > 0) {\n"
+                                   "        ssize_t written = write(1, p, n);\n"
+                                   "        if (written < 0)\n"
+                                   "            return 1;\n"
+                                   "        p += written;\n"
+                                   "        n -= written;\n"
+                                   "    }\n"
+                                   "    return 0;\n"
+                                   "}\n");
 }
 
-void compile(char *c_filename, char *output_name)
+int compile(const char *c_filename, const char *output_name, FILE *diag)
 {
-    char cmd[256];
-    sprintf(cmd, "gcc -o %s %s", output_name, c_filename);
-    system(cmd);
-}
\ No newline at end of file
+    char *argv[] = {CC_PROGRAM, "-o", (char *)output_name, (char *)c_filename, NULL};
+    return run_command(argv, diag);
+}
@@ -0,0 +1,333 @@
+#include "codegen_x86.h"
+#include "codegen.h"
+#include "trace.h"
+#include <elf.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// 程序头：一个可读可执行的PT_LOAD覆盖整个文件，另加PT_GNU_STACK声明栈不可执行
+#define NATIVE_BASE_ADDRESS 0x400000
+#define NATIVE_HEADER_SIZE (sizeof(Elf64_Ehdr) + 2 * sizeof(Elf64_Phdr))
+
+typedef struct
+{
+    unsigned char *data;
+    size_t size;
+    size_t capacity;
+} ByteBuffer;
+
+// 需要在最后回填的32位相对地址
+typedef enum
+{
+    FIXUP_CALL, // call rel32，目标是函数
+    FIXUP_DATA, // lea rsi, [rip+disp32]，目标是数据区中的字符串
+} FixupKind;
+
+typedef struct
+{
+    FixupKind kind;
+    size_t code_offset; // disp32在代码中的位置
+    size_t target;      // 函数下标或数据偏移
+} Fixup;
+
+typedef struct
+{
+    ByteBuffer code;
+    ByteBuffer data;
+    Fixup *fixups;
+    size_t fixup_count, fixup_capacity;
+    FunctionTable functions;
+    size_t *function_offsets; // 每个函数在代码中的起始位置
+    FILE *diag;
+} NativeEmitter;
+
+static void buffer_append(ByteBuffer *buffer, const void *bytes, size_t size)
+{
+    if (buffer->size + size > buffer->capacity)
+    {
+        size_t capacity = buffer->capacity ? buffer->capacity : 4096;
+        while (capacity < buffer->size + size)
+            capacity *= 2;
+        unsigned char *grown = realloc(buffer->data, capacity);
+        if (!grown)
+        {
+            fprintf(stderr, "Error: Out of memory (native code buffer)\n");
+            exit(1);
+        }
+        buffer->data = grown;
+        buffer->capacity = capacity;
+    }
+    memcpy(buffer->data + buffer->size, bytes, size);
+    buffer->size += size;
+}
+
+static void emit_u8(NativeEmitter *e, unsigned char byte)
+{
+    buffer_append(&e->code, &byte, 1);
+}
+
+static void emit_u32(NativeEmitter *e, uint32_t value)
+{
+    unsigned char bytes[4] = {value & 0xff, (value >> 8) & 0xff, (value >> 16) & 0xff, value >> 24};
+    buffer_append(&e->code, bytes, 4);
+}
+
+static void add_fixup(NativeEmitter *e, FixupKind kind, size_t target)
+{
+    if (e->fixup_count == e->fixup_capacity)
+    {
+        e->fixup_capacity = e->fixup_capacity ? e->fixup_capacity * 2 : 64;
+        e->fixups = realloc(e->fixups, e->fixup_capacity * sizeof(Fixup));
+        if (!e->fixups)
+        {
+            fprintf(stderr, "Error: Out of memory (native fixups)\n");
+            exit(1);
+        }
+    }
+    e->fixups[e->fixup_count].kind = kind;
+    e->fixups[e->fixup_count].code_offset = e->code.size;
+    e->fixups[e->fixup_count].target = target;
+    e->fixup_count++;
+    emit_u32(e, 0);
+}
+
+// 跳回到loop的rel8
+static void emit_jump_back(NativeEmitter *e, unsigned char opcode, size_t loop)
+{
+    emit_u8(e, opcode);
+    emit_u8(e, (unsigned char)(int8_t)((int64_t)loop - (int64_t)(e->code.size + 1)));
+}
+
+// write(1, data + offset, length)，写不完时接着写剩下的部分，EINTR时重试。
+// 其他错误（包括一次写出0字节）直接exit(1)，不会悄悄丢掉后面的输出
+static void emit_write(NativeEmitter *e, size_t data_offset, size_t length)
+{
+    emit_u8(e, 0x48); // lea rsi, [rip+disp32]
+    emit_u8(e, 0x8d);
+    emit_u8(e, 0x35);
+    add_fixup(e, FIXUP_DATA, data_offset);
+    emit_u8(e, 0xba); // mov edx, length
+    emit_u32(e, (uint32_t)length);
+
+    size_t loop = e->code.size;
+    emit_u8(e, 0xb8); // mov eax, 1 (SYS_write)
+    emit_u32(e, 1);
+    emit_u8(e, 0xbf); // mov edi, 1 (stdout)
+    emit_u32(e, 1);
+    emit_u8(e, 0x0f); // syscall，只改写rax、rcx和r11
+    emit_u8(e, 0x05);
+    emit_u8(e, 0x48); // cmp rax, -EINTR
+    emit_u8(e, 0x83);
+    emit_u8(e, 0xf8);
+    emit_u8(e, (unsigned char)-EINTR);
+    emit_jump_back(e, 0x74, loop); // je loop
+    emit_u8(e, 0x48); // test rax, rax
+    emit_u8(e, 0x85);
+    emit_u8(e, 0xc0);
+    emit_u8(e, 0x7f); // jg跳过下面12字节的exit(1)
+    emit_u8(e, 12);
+    emit_u8(e, 0xb8); // mov eax, 60 (SYS_exit)
+    emit_u32(e, 60);
+    emit_u8(e, 0xbf); // mov edi, 1
+    emit_u32(e, 1);
+    emit_u8(e, 0x0f); // syscall
+    emit_u8(e, 0x05);
+    emit_u8(e, 0x48); // add rsi, rax
+    emit_u8(e, 0x01);
+    emit_u8(e, 0xc6);
+    emit_u8(e, 0x48); // sub rdx, rax
+    emit_u8(e, 0x29);
+    emit_u8(e, 0xc2);
+    emit_jump_back(e, 0x75, loop); // jnz loop
+}
+
+// 生成一串语句；连续的say合并成一次write
+static int emit_statements(NativeEmitter *e, ASTNode **stmts, int count)
+{
+    for (int i = 0; i < count;)
+    {
+        ASTNode *stmt = stmts[i];
+        if (stmt->type == STMT_SAY)
+        {
+            size_t start = e->data.size;
+            while (i < count && stmts[i]->type == STMT_SAY)
+            {
+                buffer_append(&e->data, stmts[i]->value, stmts[i]->length);
+                buffer_append(&e->data, "\n", 1);
+                i++;
+            }
+            emit_write(e, start, e->data.size - start);
+            continue;
+        }
+
+        if (stmt->type == STMT_FUNCTION_CALL)
+        {
+            FunctionDef *def = find_function(&e->functions, stmt->value, stmt->length);
+            if (!def)
+            {
+                fprintf(e->diag, "Error: call to undefined function '%.*s'\n", (int)stmt->length, stmt->value);
+                return -1;
+            }
+            emit_u8(e, 0xe8); // call rel32
+            add_fixup(e, FIXUP_CALL, (size_t)(def - e->functions.defs));
+        }
+        // 和C后端一样，函数体里嵌套的函数定义不生成代码
+        i++;
+    }
+    return 0;
+}
+
+// 在输出旁边独占地创建临时文件。不用mkstemp：它固定用0600创建，
+// 这里用0777让umask决定最终权限，和gcc/ld的行为一致
+static int create_temp(const char *output_name, char *temp, size_t size)
+{
+    static atomic_uint counter;
+    for (int attempt = 0; attempt < 100; attempt++)
+    {
+        if (snprintf(temp, size, "%s.%d.%u", output_name, (int)getpid(), atomic_fetch_add(&counter, 1)) >=
+            (int)size)
+        {
+            errno = ENAMETOOLONG;
+            return -1;
+        }
+        int fd = open(temp, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0777);
+        if (fd >= 0 || errno != EEXIST)
+            return fd;
+    }
+    return -1;
+}
+
+static int write_elf(NativeEmitter *e, const char *output_name)
+{
+    size_t code_start = NATIVE_HEADER_SIZE;
+    size_t data_start = code_start + e->code.size;
+    size_t file_size = data_start + e->data.size;
+    if (file_size > 0x7fffffff)
+    {
+        fprintf(e->diag, "Error: program too large for the native backend\n");
+        return -1;
+    }
+
+    // 回填相对地址：目标 - 下一条指令（即disp32之后）的地址
+    for (size_t i = 0; i < e->fixup_count; i++)
+    {
+        Fixup *fixup = &e->fixups[i];
+        size_t target = fixup->kind == FIXUP_CALL
+                            ? code_start + e->function_offsets[fixup->target]
+                            : data_start + fixup->target;
+        int32_t rel = (int32_t)((int64_t)target - (int64_t)(code_start + fixup->code_offset + 4));
+        memcpy(e->code.data + fixup->code_offset, &rel, 4);
+    }
+
+    Elf64_Ehdr ehdr;
+    memset(&ehdr, 0, sizeof(ehdr));
+    memcpy(ehdr.e_ident, ELFMAG, SELFMAG);
+    ehdr.e_ident[EI_CLASS] = ELFCLASS64;
+    ehdr.e_ident[EI_DATA] = ELFDATA2LSB;
+    ehdr.e_ident[EI_VERSION] = EV_CURRENT;
+    ehdr.e_ident[EI_OSABI] = ELFOSABI_SYSV;
+    ehdr.e_type = ET_EXEC;
+    ehdr.e_machine = EM_X86_64;
+    ehdr.e_version = EV_CURRENT;
+    ehdr.e_entry = NATIVE_BASE_ADDRESS + code_start;
+    ehdr.e_phoff = sizeof(Elf64_Ehdr);
+    ehdr.e_ehsize = sizeof(Elf64_Ehdr);
+    ehdr.e_phentsize = sizeof(Elf64_Phdr);
+    ehdr.e_phnum = 2;
+
+    Elf64_Phdr phdr[2];
+    memset(phdr, 0, sizeof(phdr));
+    phdr[0].p_type = PT_LOAD;
+    phdr[0].p_flags = PF_R | PF_X;
+    phdr[0].p_offset = 0;
+    phdr[0].p_vaddr = NATIVE_BASE_ADDRESS;
+    phdr[0].p_paddr = NATIVE_BASE_ADDRESS;
+    phdr[0].p_filesz = file_size;
+    phdr[0].p_memsz = file_size;
+    phdr[0].p_align = 0x1000;
+    phdr[1].p_type = PT_GNU_STACK;
+    phdr[1].p_flags = PF_R | PF_W;
+    phdr[1].p_align = 16;
+
+    // 写到输出旁边的临时文件再rename：输出可能是缓存条目的硬链接，也可能正在运行，
+    // 不能原地改写
+    char temp[PATH_MAX + 32];
+    int fd = create_temp(output_name, temp, sizeof(temp));
+    if (fd < 0)
+    {
+        fprintf(e->diag, "Error creating %s: %s\n", output_name, strerror(errno));
+        return -1;
+    }
+    FILE *out = fdopen(fd, "wb");
+    if (!out)
+    {
+        fprintf(e->diag, "Error writing %s: %s\n", output_name, strerror(errno));
+        close(fd);
+        unlink(temp);
+        return -1;
+    }
+    fwrite(&ehdr, sizeof(ehdr), 1, out);
+    fwrite(phdr, sizeof(phdr), 1, out);
+    fwrite(e->code.data, 1, e->code.size, out);
+    if (e->data.size)
+        fwrite(e->data.data, 1, e->data.size, out);
+    if (fclose(out) != 0 || rename(temp, output_name) != 0)
+    {
+        fprintf(e->diag, "Error writing %s: %s\n", output_name, strerror(errno));
+        unlink(temp);
+        return -1;
+    }
+    return 0;
+}
+
+int generate_native_executable(ASTNode **nodes, int count, const char *output_name, FILE *diag)
+{
+    NativeEmitter e;
+    memset(&e, 0, sizeof(e));
+    e.diag = diag;
+
+    // 收集顶层函数定义
+    Arena arena;
+    arena_init(&arena);
+    build_function_table(&e.functions, nodes, count, &arena);
+    e.function_offsets = malloc((e.functions.count + 1) * sizeof(size_t));
+    if (!e.function_offsets)
+    {
+        fprintf(diag, "Error: Out of memory (native function table)\n");
+        arena_free(&arena);
+        return -1;
+    }
+    TRACE(TRACE_CODEGEN, "native: %d top-level nodes, %d functions", count, e.functions.count);
+
+    // _start：依次执行start:块中的语句，然后exit(0)
+    int status = emit_statements(&e, nodes, count);
+    emit_u8(&e, 0xb8); // mov eax, 60 (SYS_exit)
+    emit_u32(&e, 60);
+    emit_u8(&e, 0x31); // xor edi, edi
+    emit_u8(&e, 0xff);
+    emit_u8(&e, 0x0f); // syscall
+    emit_u8(&e, 0x05);
+
+    for (int i = 0; i < e.functions.count && status == 0; i++)
+    {
+        e.function_offsets[i] = e.code.size;
+        status = emit_statements(&e, e.functions.defs[i].body, e.functions.defs[i].body_count);
+        emit_u8(&e, 0xc3); // ret
+    }
+
+    if (status == 0)
+        status = write_elf(&e, output_name);
+
+    free(e.code.data);
+    free(e.data.data);
+    free(e.fixups);
+    free(e.function_offsets);
+    arena_free(&arena);
+    return status;
+}
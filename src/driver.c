@@ -0,0 +1,511 @@
+#define _GNU_SOURCE // memmem
+#include "driver.h"
+#include "lexer.h"
+#include "parser.h"
+#include "codegen.h"
+#include "codegen_x86.h"
+#include "vm.h"
+#include "optimize.h"
+#include "evaluate.h"
+#include "scan.h"
+#include "split.h"
+#include "arena.h"
+#include "trace.h"
+#include "toolchain.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// 这一行是否包含分隔字符串。separate_header只看它第一次出现的位置，
+// 读到这一行为止，C头怎么划分就和读整个文件时完全一样
+static int line_has_magic(const char *line, size_t length)
+{
+    return memmem(line, length, HERCODE_MAGIC, strlen(HERCODE_MAGIC)) != NULL;
+}
+
+// 读标准输入的开头：C头要整个放在内存里，所以一直读到包含分隔字符串的行为止。
+// 不能靠行首的function/start:判断HerCode已经开始，C头里也可以有start:这样的标号；
+// 没有分隔行时整个输入都读进来。剩下的部分由流式lexer接着读
+static int read_stdin_head(SourceFile *file)
+{
+    size_t capacity = LEXER_WINDOW_SIZE;
+    size_t length = 0;
+    size_t line_start = 0; // 第一个还没检查过的完整行
+    char *data = malloc(capacity + 1);
+    if (!data)
+        return -1;
+    for (int found = 0; !found;)
+    {
+        if (length == capacity)
+        {
+            char *grown = realloc(data, 2 * capacity + 1);
+            if (!grown)
+            {
+                free(data);
+                errno = ENOMEM;
+                return -1;
+            }
+            data = grown;
+            capacity *= 2;
+        }
+        ssize_t n = read(STDIN_FILENO, data + length, capacity - length);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+        {
+            int saved = errno;
+            free(data);
+            errno = saved;
+            return -1;
+        }
+        if (n == 0)
+            break;
+        length += (size_t)n;
+        const char *newline;
+        while (!found && (newline = memchr(data + line_start, '\n', length - line_start)))
+        {
+            found = line_has_magic(data + line_start, (size_t)(newline - data) - line_start);
+            line_start = (size_t)(newline - data) + 1;
+        }
+    }
+    data[length] = '\0';
+    file->data = data;
+    file->length = length;
+    file->mapped_length = 0;
+    return 0;
+}
+
+void separate_header(const char *source, size_t length, const char *magic_string,
+                     SourceView *header, SourceView *hercode)
+{
+    // 没有找到特殊字符串时整个文件都是HerCode
+    header->data = NULL;
+    header->length = 0;
+    hercode->data = source;
+    hercode->length = length;
+
+    const char *magic_pos = strstr(source, magic_string);
+    if (magic_pos == NULL)
+    {
+        return;
+    }
+
+    // 确保特殊字符串在行首
+    if (magic_pos != source && magic_pos[-1] != '\n' && magic_pos[-1] != '\r')
+    {
+        return; // 不在行首
+    }
+    header->data = source;
+    header->length = (size_t)(magic_pos - source);
+
+    // HerCode部分从下一行开始；没有换行符时特殊字符串后没有内容
+    const char *line_end = strchr(magic_pos, '\n');
+    const char *start = line_end ? line_end + 1 : source + length;
+
+    // 特殊处理CRLF换行
+    if (line_end && line_end > magic_pos && line_end[-1] == '\r')
+    {
+        // 如果前面有CR，跳过它
+        start = line_end;
+    }
+    hercode->data = start;
+    hercode->length = (size_t)(source + length - start);
+}
+
+void driver_prepare(CompileOptions *options)
+{
+    // 写到文件里的C代码要能单独编译，不能依赖-include
+    // --run不调用gcc，也就用不上预编译prelude
+    if ((options->emit_c_path || options->run) && options->prelude == PRELUDE_PCH)
+        options->prelude = PRELUDE_FULL;
+
+    // 预编译prelude不可用时退回到直接写出头文件
+    if (options->prelude == PRELUDE_PCH &&
+        (!options->cache ||
+         prelude_prepare_pch(options->cache, options->prelude_path, sizeof(options->prelude_path)) != 0))
+        options->prelude = PRELUDE_FULL;
+
+    if (!options->cache)
+        options->use_cache = 0;
+}
+
+// 写进缓存键的编译参数，不同的prelude模式生成不同的可执行文件
+static const char *const prelude_flags[] = {
+    [PRELUDE_FULL] = CC_PROGRAM " -x c",
+    [PRELUDE_PCH] = CC_PROGRAM " -x c -include prelude",
+    [PRELUDE_MINIMAL] = CC_PROGRAM " -x c prelude=minimal",
+};
+
+// 生成C代码：程序的输出已经在编译时算出来（constant不为NULL）时只生成一次write
+static void generate_code(const char *c_header, ASTNode **nodes, int node_count, const CodeBuffer *constant,
+                          const CompileOptions *options, CodeBuffer *code)
+{
+    if (constant)
+        generate_constant_program(constant->data, constant->length, code);
+    else
+        generate_c_code(c_header, nodes, node_count, options->prelude, options->codegen_jobs, code);
+}
+
+// 生成C代码并交给gcc，返回gcc的退出码
+static int generate_and_compile(const char *c_header, ASTNode **nodes, int node_count, const CodeBuffer *constant,
+                                const char *output_name, const CompileOptions *options, FILE *diag)
+{
+    TimeReport *report = options->time_report;
+    PhaseTimer timer;
+    CodeBuffer code;
+    if (options->emit_c_path)
+    {
+        // 需要保留C代码时才写文件
+        int fd = open(options->emit_c_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd < 0)
+        {
+            fprintf(diag, "Error creating C file %s: %s\n", options->emit_c_path, strerror(errno));
+            return -1;
+        }
+        phase_begin(report, &timer);
+        codebuf_init(&code, 1 << 16);
+        generate_code(c_header, nodes, node_count, constant, options, &code);
+        int written = codebuf_write(&code, fd);
+        phase_end(report, PHASE_CODEGEN, &timer);
+        if (report)
+            report->c_bytes = code.length;
+        codebuf_free(&code);
+        if (close(fd) != 0 || written != 0)
+        {
+            fprintf(diag, "Error writing C file %s: %s\n", options->emit_c_path, strerror(errno));
+            return -1;
+        }
+
+        phase_begin(report, &timer);
+        int status = compile(options->emit_c_path, output_name, diag);
+        phase_end(report, PHASE_CC, &timer);
+        return status;
+    }
+
+    // 先启动gcc，它加载的同时在内存里生成C代码，最后一次写进管道
+    char *extra_args[] = {"-include", (char *)options->prelude_path, NULL};
+    CompileJob job;
+    phase_begin(report, &timer);
+    int use_pch = options->prelude == PRELUDE_PCH && !constant;
+    int started = compile_begin(&job, output_name, use_pch ? extra_args : NULL, diag);
+    phase_end(report, PHASE_CC, &timer);
+    if (started != 0)
+        return -1;
+
+    phase_begin(report, &timer);
+    codebuf_init(&code, 1 << 16);
+    generate_code(c_header, nodes, node_count, constant, options, &code);
+    phase_end(report, PHASE_CODEGEN, &timer);
+    if (report)
+        report->c_bytes = code.length;
+
+    // gcc提前退出时写管道会失败，以它的退出码为准
+    phase_begin(report, &timer);
+    codebuf_write(&code, fileno(job.input));
+    int status = compile_end(&job);
+    phase_end(report, PHASE_CC, &timer);
+    codebuf_free(&code);
+    return status;
+}
+
+// --stats用：单独把源码词法分析一遍，报告吞吐量
+static void report_lexer_throughput(const char *source, FILE *diag)
+{
+    Arena arena;
+    arena_init(&arena);
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    Lexer *lexer = new_lexer(source, &arena);
+    size_t tokens = 0;
+    for (Token token = next_token(lexer); token.type != TOKEN_EOF; token = next_token(lexer))
+        tokens++;
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    arena_free(&arena);
+
+    double seconds = (double)(end.tv_sec - start.tv_sec) + (double)(end.tv_nsec - start.tv_nsec) / 1e9;
+    double megabytes = (double)strlen(source) / 1e6;
+    fprintf(diag, "lexer: %zu tokens, %.2f MB in %.3f ms (%.1f MB/s, %s scanner)\n",
+            tokens, megabytes, seconds * 1e3, seconds > 0 ? megabytes / seconds : 0.0, scan_implementation());
+}
+
+// --time-report用：单独把源码词法分析一遍，按类型统计token
+static void count_tokens(const char *source, TimeReport *report)
+{
+    Arena arena;
+    arena_init(&arena);
+    Lexer *lexer = new_lexer(source, &arena);
+    for (Token token = next_token(lexer); token.type != TOKEN_EOF; token = next_token(lexer))
+    {
+        report->tokens[token.type]++;
+        report->token_total++;
+    }
+    arena_free(&arena);
+}
+
+static void count_nodes(ASTNode **nodes, int count, TimeReport *report)
+{
+    for (int i = 0; i < count; i++)
+    {
+        report->ast_nodes++;
+        if (nodes[i]->type == STMT_FUNCTION_DEF)
+        {
+            report->functions++;
+            count_nodes(nodes[i]->body, nodes[i]->body_count, report);
+        }
+    }
+}
+
+// 词法分析、解析和调用图优化；失败时返回NULL，错误已经写到diag。
+// input_fd不是-1时hercode_source只是输入的开头，剩下的部分边读边解析
+static ASTNode **parse_and_optimize(const char *source_path, const char *source, const char *c_header,
+                                    const char *hercode_source, int input_fd, const CompileOptions *options,
+                                    Arena *arena, int *node_count, OptimizeStats *opt_stats, FILE *diag)
+{
+    TimeReport *report = options->time_report;
+    PhaseTimer timer;
+    // 流式输入只能读一遍，不单独统计词法分析
+    if (options->show_stats && input_fd < 0)
+        report_lexer_throughput(hercode_source, diag);
+    if (report && input_fd < 0)
+    {
+        phase_begin(report, &timer);
+        count_tokens(hercode_source, report);
+        phase_end(report, PHASE_LEX, &timer);
+    }
+
+    // 创建词法分析器和解析器；错误信息带上文件名和行号
+    Lexer *lexer = input_fd >= 0 ? new_stream_lexer(input_fd, hercode_source, strlen(hercode_source), arena)
+                                  : new_lexer(hercode_source, arena);
+    Parser *parser = new_parser(lexer);
+    parser->diag = diag;
+    parser->filename = source_path;
+    for (const char *p = source; p < hercode_source; p++)
+    {
+        if (*p == '\n')
+            parser->first_line++;
+    }
+
+    // 解析程序
+    phase_begin(report, &timer);
+    ASTNode **nodes = parse_program(parser, node_count);
+    phase_end(report, PHASE_PARSE, &timer);
+    if (nodes)
+        TRACE(TRACE_PARSER, "Parsed %d nodes", *node_count);
+    if (nodes && lexer->read_error)
+    {
+        fprintf(diag, "Error reading file: %s: %s\n", source_path, strerror(lexer->read_error));
+        nodes = NULL;
+    }
+    if (report && lexer_is_streaming(lexer))
+        report->bytes_read = (size_t)(hercode_source - source) + lexer->base + lexer->window_length;
+    if (nodes && report)
+        count_nodes(nodes, *node_count, report);
+
+    // 调用图优化；调用了未定义的函数时在这里报错，不用等到gcc链接
+    phase_begin(report, &timer);
+    if (nodes && optimize_program(&nodes, node_count, c_header, options->opt_level,
+                                  arena, source_path, diag, opt_stats) != 0)
+        nodes = NULL;
+    phase_end(report, PHASE_OPTIMIZE, &timer);
+
+    return nodes;
+}
+
+int compile_file(const char *source_path, const char *output_name, const CompileOptions *options, FILE *diag)
+{
+    TimeReport *report = options->time_report;
+    PhaseTimer timer;
+
+    // 读取整个文件：普通文件直接映射，其他的用read；"-"表示标准输入，
+    // 只先读到C头结束，其余部分解析时边读边处理。编译服务器把源码连同AST长期留在缓存里，
+    // 文件之后被截断或原地修改时映射会读到新内容甚至SIGBUS，所以服务器总是读一份副本
+    int streaming = strcmp(source_path, "-") == 0;
+    SourceFile file;
+    struct timespec load_start, load_end;
+    clock_gettime(CLOCK_MONOTONIC, &load_start);
+    phase_begin(report, &timer);
+    int loaded = streaming             ? read_stdin_head(&file)
+                 : options->ast_cache ? source_read(source_path, &file)
+                                      : source_load(source_path, &file);
+    phase_end(report, PHASE_READ, &timer);
+    clock_gettime(CLOCK_MONOTONIC, &load_end);
+    if (loaded != 0)
+    {
+        fprintf(diag, "Error reading file: %s: %s\n", source_path, strerror(errno));
+        return 1;
+    }
+    if (report)
+        report->bytes_read = file.length;
+    if (options->show_stats)
+    {
+        double seconds = (double)(load_end.tv_sec - load_start.tv_sec) +
+                         (double)(load_end.tv_nsec - load_start.tv_nsec) / 1e9;
+        double megabytes = (double)file.length / 1e6;
+        fprintf(diag, "source: %.2f MB loaded with %s in %.3f ms (%.1f MB/s)\n", megabytes, source_method(&file),
+                seconds * 1e3, seconds > 0 ? megabytes / seconds : 0.0);
+    }
+    char *source = file.data;
+
+    // 尝试分离C头部分
+    SourceView header, hercode;
+    phase_begin(report, &timer);
+    separate_header(source, file.length, HERCODE_MAGIC, &header, &hercode);
+    phase_end(report, PHASE_HEADER, &timer);
+    // C头后面紧跟着分隔行，把分隔行的第一个字节改成'\0'，C头就能直接当字符串用，不用复制。
+    // 映射是私有的，只有这一页会被复制，源文件不受影响
+    const char *c_header = NULL;
+    if (header.data)
+    {
+        source[header.length] = '\0';
+        c_header = source;
+        TRACE(TRACE_DRIVER, "C header:\n%s", c_header);
+    }
+    const char *hercode_source = hercode.data;
+
+    // 输出分离结果用于调试
+    TRACE(TRACE_DRIVER, "HerCode source to parse:\n%s", hercode_source);
+
+    // 虚拟机只能执行纯HerCode，C头需要gcc
+    if (options->run && c_header)
+    {
+        fprintf(diag, "Error: %s contains a C header before \"%s\"; --run only supports pure HerCode programs\n",
+                source_path, HERCODE_MAGIC);
+        source_unload(&file);
+        return 1;
+    }
+
+    // 缓存命中时跳过词法分析、解析、代码生成和gcc
+    // 原生后端不能处理C头，这类文件仍然交给gcc
+    int native = options->backend == BACKEND_NATIVE && !c_header;
+    if (options->backend == BACKEND_NATIVE && c_header)
+        TRACE(TRACE_DRIVER, "%s has a C header, using the C backend", source_path);
+
+    // 构建缓存的键要用到完整的源码，标准输入读不到
+    int use_cache = options->use_cache && !options->run && !streaming;
+    char cache_key[SHA256_HEX_SIZE];
+    char flags[128];
+    snprintf(flags, sizeof(flags), "%s -O%d", native ? "native-x86_64" : prelude_flags[options->prelude],
+             (int)options->opt_level);
+    if (use_cache && cache_compute_key(hercode_source, c_header, flags, cache_key) != 0)
+        use_cache = 0;
+    if (use_cache && cache_lookup(options->cache, cache_key, output_name))
+    {
+        source_unload(&file);
+        TRACE(TRACE_DRIVER, "Successfully generated: %s (cached)", output_name);
+        return 0;
+    }
+
+    // 编译服务器：同一文件内容没变时直接复用上次优化过的AST
+    AstCacheEntry *cached = NULL;
+    char ast_hash[SHA256_HEX_SIZE];
+    if (options->ast_cache && !streaming)
+    {
+        ast_cache_hash(source, file.length, ast_hash);
+        cached = ast_cache_acquire(options->ast_cache, source_path, ast_hash, options->opt_level);
+    }
+
+    // 本次编译的所有token、解析器和AST节点都从arena分配
+    Arena arena;
+    arena_init(&arena);
+    int node_count = 0;
+    ASTNode **nodes = NULL;
+    int status = 1;
+    OptimizeStats opt_stats = {0};
+    int evaluated = 0;
+    size_t evaluated_bytes = 0;
+    if (cached)
+    {
+        TRACE(TRACE_DRIVER, "%s: reusing cached AST", source_path);
+        nodes = cached->nodes;
+        node_count = cached->count;
+    }
+    else
+        nodes = parse_and_optimize(source_path, source, c_header, hercode_source, streaming ? STDIN_FILENO : -1,
+                                   options, &arena, &node_count, &opt_stats, diag);
+
+    if (nodes)
+    {
+        if (options->run)
+        {
+            // 翻译成字节码直接执行，不生成可执行文件
+            phase_begin(report, &timer);
+            BytecodeProgram *program = vm_compile(nodes, node_count, &arena, diag);
+            phase_end(report, PHASE_CODEGEN, &timer);
+            phase_begin(report, &timer);
+            if (program)
+                status = vm_run(program, STDOUT_FILENO, diag);
+            phase_end(report, PHASE_RUN, &timer);
+        }
+        else if (native)
+        {
+            phase_begin(report, &timer);
+            status = generate_native_executable(nodes, node_count, output_name, diag);
+            phase_end(report, PHASE_CODEGEN, &timer);
+        }
+        else
+        {
+            // 输出文件可能是以前--cache留下的缓存条目硬链接，先断开，避免gcc原地改写缓存。
+            // 原生后端写临时文件再rename，--run不写文件，都不需要
+            struct stat output_stat;
+            if (stat(output_name, &output_stat) == 0 && output_stat.st_nlink > 1)
+                unlink(output_name);
+
+            // -O2时没有C头的程序的输出在编译时就能算出来；有递归或者输出太大时照常生成代码
+            CodeBuffer constant;
+            codebuf_init(&constant, 1 << 12);
+            phase_begin(report, &timer);
+            evaluated = options->opt_level >= OPT_FULL && !c_header &&
+                        evaluate_program(nodes, node_count, EVALUATE_MAX_OUTPUT, &arena, &constant) == 0;
+            phase_end(report, PHASE_OPTIMIZE, &timer);
+            if (evaluated)
+                evaluated_bytes = constant.length;
+
+            // 生成C代码并编译
+            if (options->split_units > 1 && !evaluated)
+                status = split_compile(c_header, nodes, node_count, output_name, options, diag);
+            else
+                status = generate_and_compile(c_header, nodes, node_count, evaluated ? &constant : NULL,
+                                              output_name, options, diag);
+            codebuf_free(&constant);
+            if (status != 0)
+                fprintf(diag, "Error: C compiler failed for %s\n", source_path);
+        }
+        if (status == 0 && use_cache)
+            cache_store(options->cache, cache_key, output_name);
+    }
+
+    if (options->show_stats && cached)
+        fprintf(diag, "ast cache: reused %d nodes\n", node_count);
+    else if (options->show_stats)
+    {
+        fprintf(diag, "arena: %zu allocations from %zu chunks (%zu mallocs saved), %zu bytes\n",
+                arena.alloc_count, arena.chunk_count,
+                arena.alloc_count - arena.chunk_count, arena.bytes_used);
+        fprintf(diag, "optimizer (-O%d): %d functions removed, %d calls inlined, %d recursive\n",
+                (int)options->opt_level, opt_stats.functions_removed, opt_stats.calls_inlined,
+                opt_stats.recursive_functions);
+    }
+    if (options->show_stats && evaluated)
+        fprintf(diag, "evaluator: program output (%zu bytes) computed at compile time\n", evaluated_bytes);
+
+    // 清理；新解析的AST连同源码交给缓存保存
+    if (cached)
+        ast_cache_release(options->ast_cache, cached);
+    if (!cached && nodes && options->ast_cache && !streaming)
+    {
+        ast_cache_insert(options->ast_cache, source_path, ast_hash, options->opt_level,
+                         &file, c_header, &arena, nodes, node_count);
+    }
+    arena_free(&arena);
+    source_unload(&file);
+
+    if (status != 0)
+        return 1;
+    if (!options->run)
+        TRACE(TRACE_DRIVER, "Successfully generated: %s", output_name);
+    return 0;
+}
@@ -0,0 +1,88 @@
+#include "evaluate.h"
+#include "codegen.h"
+#include "trace.h"
+#include <string.h>
+
+// 函数的求值状态
+enum
+{
+    EVAL_PENDING,
+    EVAL_ACTIVE, // 正在展开，又被调用到说明有递归
+    EVAL_DONE,   // 输出是output里的[offset, offset + length)
+};
+
+// 展开中的一段语句；每个函数同时最多展开一次，所以栈深不超过函数个数加一
+typedef struct
+{
+    ASTNode **stmts;
+    int count;
+    int next;
+    int function; // 正在展开的函数下标，start:为-1
+    size_t start; // 这个函数的输出从哪里开始
+} EvalFrame;
+
+int evaluate_program(ASTNode **nodes, int count, size_t limit, Arena *arena, CodeBuffer *output)
+{
+    FunctionTable table;
+    build_function_table(&table, nodes, count, arena);
+    unsigned char *state = arena_alloc(arena, table.count + 1);
+    memset(state, EVAL_PENDING, table.count + 1);
+    size_t *offset = arena_alloc(arena, (table.count + 1) * sizeof(size_t));
+    size_t *length = arena_alloc(arena, (table.count + 1) * sizeof(size_t));
+
+    // 顶层的非函数语句就是start:的内容；调用链可能很深，用显式的栈代替递归
+    EvalFrame *frames = arena_alloc(arena, (table.count + 1) * sizeof(EvalFrame));
+    int depth = 0;
+    frames[depth++] = (EvalFrame){nodes, count, 0, -1, 0};
+    while (depth > 0)
+    {
+        EvalFrame *frame = &frames[depth - 1];
+        if (frame->next == frame->count)
+        {
+            // 函数展开完了，记下它的输出供以后的调用复制
+            if (frame->function >= 0)
+            {
+                state[frame->function] = EVAL_DONE;
+                offset[frame->function] = frame->start;
+                length[frame->function] = output->length - frame->start;
+            }
+            depth--;
+            continue;
+        }
+
+        ASTNode *stmt = frame->stmts[frame->next++];
+        if (stmt->type == STMT_SAY)
+        {
+            if (output->length + stmt->length + 1 > limit)
+                return -1;
+            codebuf_append(output, stmt->value, stmt->length);
+            codebuf_append_char(output, '\n');
+            continue;
+        }
+        if (stmt->type != STMT_FUNCTION_CALL)
+            continue; // 顶层的函数定义
+
+        FunctionDef *def = find_function(&table, stmt->value, stmt->length);
+        if (!def)
+            return -1; // 优化器已经报过未定义的函数，这里只是保险
+        int index = (int)(def - table.defs);
+        if (state[index] == EVAL_ACTIVE)
+        {
+            TRACE(TRACE_CODEGEN, "evaluator: %.*s is recursive", (int)def->name_length, def->name);
+            return -1;
+        }
+        if (state[index] == EVAL_DONE)
+        {
+            if (output->length + length[index] > limit)
+                return -1;
+            codebuf_append_range(output, offset[index], length[index]);
+            continue;
+        }
+        state[index] = EVAL_ACTIVE;
+        frames[depth++] = (EvalFrame){def->body, def->body_count, 0, index, output->length};
+    }
+    if (output->failed)
+        return -1;
+    TRACE(TRACE_CODEGEN, "evaluator: %zu bytes of output", output->length);
+    return 0;
+}
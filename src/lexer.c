@@ -1,160 +1,334 @@
 #include "lexer.h"
-#include <ctype.h>
+#include "scan.h"
+#include "trace.h"
+#include <errno.h>
 #include <string.h>
-#include <stdlib.h>
-#include <stdio.h>
+#include <unistd.h>
 
-Lexer *new_lexer(char *source)
+// 字符分类表：每个字节查一次表，代替逐个调用isspace/isalpha/isalnum。
+// 只按ASCII分类，与C locale下的ctype结果一致；0x80以上的UTF-8字节不属于任何类。
+// 字符串、注释和缩进这些长段落由scan.h里的向量扫描一次跳过
+enum
 {
-    Lexer *lexer = malloc(sizeof(Lexer));
+    CC_SPACE = 1 << 0,       // 除换行以外的空白
+    CC_IDENT_START = 1 << 1, // 字母
+    CC_IDENT = 1 << 2,       // 字母、数字、下划线
+};
+
+#define W CC_SPACE
+#define L (CC_IDENT_START | CC_IDENT)
+#define D CC_IDENT
+static const unsigned char char_class[256] = {
+    0, 0, 0, 0, 0, 0, 0, 0, 0, W, 0, W, W, W, 0, 0, // 0x00
+    0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 0x10
+    W, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, // 0x20
+    D, D, D, D, D, D, D, D, D, D, 0, 0, 0, 0, 0, 0, // 0x30
+    0, L, L, L, L, L, L, L, L, L, L, L, L, L, L, L, // 0x40
+    L, L, L, L, L, L, L, L, L, L, L, 0, 0, 0, 0, D, // 0x50
+    0, L, L, L, L, L, L, L, L, L, L, L, L, L, L, L, // 0x60
+    L, L, L, L, L, L, L, L, L, L, L, 0, 0, 0, 0, 0, // 0x70
+    // 0x80-0xff：UTF-8多字节序列，全部为0
+};
+#undef W
+#undef L
+#undef D
+
+Lexer *new_lexer(const char *source, Arena *arena)
+{
+    Lexer *lexer = arena_alloc(arena, sizeof(Lexer));
+    lexer->arena = arena;
     lexer->source = source;
     lexer->pos = 0;
     lexer->current_char = source[0];
     lexer->current_indent = 0;
+    lexer->indent_capacity = 16;
+    lexer->indent_stack = arena_alloc(arena, lexer->indent_capacity * sizeof(int));
     lexer->indent_stack[0] = 0; // 初始化缩进栈（第0级=0）
     lexer->indent_top = 0;
     lexer->pending_dedents = 0;
+    lexer->fd = -1;
+    lexer->window = NULL;
+    lexer->window_length = 0;
+    lexer->window_capacity = 0;
+    lexer->base = 0;
+    lexer->eof = 1;
+    lexer->read_error = 0;
+    lexer->line_offset = 0;
+    lexer->line = 0;
     return lexer;
 }
 
+Lexer *new_stream_lexer(int fd, const char *prefix, size_t length, Arena *arena)
+{
+    Lexer *lexer = new_lexer("", arena);
+    size_t capacity = LEXER_WINDOW_SIZE;
+    while (capacity - length < LEXER_WINDOW_SIZE / 2)
+        capacity *= 2;
+    lexer->window = arena_alloc(arena, capacity);
+    memcpy(lexer->window, prefix, length);
+    lexer->window[length] = '\0';
+    lexer->window_length = length;
+    lexer->window_capacity = capacity;
+    lexer->source = lexer->window;
+    lexer->current_char = lexer->source[0];
+    lexer->fd = fd;
+    lexer->eof = 0;
+    return lexer;
+}
+
+int lexer_is_streaming(const Lexer *lexer)
+{
+    return lexer->fd >= 0;
+}
+
+int lexer_line(Lexer *lexer, size_t offset)
+{
+    if (offset < lexer->line_offset)
+    {
+        if (lexer_is_streaming(lexer))
+            return lexer->line; // 前面的字节已经丢弃，只可能是出错信息里的近似行号
+        lexer->line_offset = 0;
+        lexer->line = 0;
+    }
+    const char *p = lexer->source + (lexer->line_offset - lexer->base);
+    const char *end = lexer->source + (offset - lexer->base);
+    while ((p = memchr(p, '\n', end - p)))
+    {
+        lexer->line++;
+        p++;
+    }
+    lexer->line_offset = offset;
+    return lexer->line;
+}
+
+// 流式输入时pos到了窗口末尾就再读一块，返回是否读到了新数据。
+// 窗口里keep之前的字节不再需要，数完换行后丢弃；一个token比半个窗口还长时窗口翻倍，
+// 旧窗口留在arena里
+static int refill(Lexer *lexer, size_t keep)
+{
+    if (lexer->eof || lexer->pos != lexer->window_length)
+        return 0;
+
+    lexer_line(lexer, lexer->base + keep);
+    memmove(lexer->window, lexer->window + keep, lexer->window_length - keep);
+    lexer->base += keep;
+    lexer->pos -= keep;
+    lexer->window_length -= keep;
+    if (lexer->window_capacity - lexer->window_length < LEXER_WINDOW_SIZE / 2)
+    {
+        char *grown = arena_alloc(lexer->arena, 2 * lexer->window_capacity);
+        memcpy(grown, lexer->window, lexer->window_length);
+        lexer->window = grown;
+        lexer->window_capacity *= 2;
+    }
+
+    ssize_t n;
+    do
+        n = read(lexer->fd, lexer->window + lexer->window_length, lexer->window_capacity - lexer->window_length - 1);
+    while (n < 0 && errno == EINTR);
+    if (n <= 0)
+    {
+        lexer->eof = 1;
+        if (n < 0)
+            lexer->read_error = errno;
+        n = 0;
+    }
+    lexer->window_length += (size_t)n;
+    lexer->window[lexer->window_length] = '\0';
+    lexer->source = lexer->window;
+    lexer->current_char = lexer->source[lexer->pos];
+    TRACE(TRACE_LEXER, "Read %zd bytes at offset %zu", n, lexer->base + lexer->window_length - (size_t)n);
+    return n > 0;
+}
+
+// 当前字节是'\0'时是否真的到了输入末尾；流式输入时先试着读入更多数据
+static int at_end(Lexer *lexer)
+{
+    return lexer->current_char == '\0' && !refill(lexer, lexer->pos);
+}
+
+// 当前位置在整个输入中的偏移
+static size_t position(const Lexer *lexer)
+{
+    return lexer->base + lexer->pos;
+}
+
+static void push_indent(Lexer *lexer, int indent)
+{
+    if (lexer->indent_top + 1 == lexer->indent_capacity)
+    {
+        // 旧的栈留在arena里，总共多占用的不超过最终大小
+        int *grown = arena_alloc(lexer->arena, 2 * lexer->indent_capacity * sizeof(int));
+        memcpy(grown, lexer->indent_stack, lexer->indent_capacity * sizeof(int));
+        lexer->indent_stack = grown;
+        lexer->indent_capacity *= 2;
+    }
+    lexer->indent_stack[++lexer->indent_top] = indent;
+}
+
 void advance(Lexer *lexer)
 {
     lexer->pos++;
     lexer->current_char = lexer->source[lexer->pos];
 }
 
-Token *new_token(TokenType type, const char *value)
+// 扫描用局部指针，结束时只写回一次pos和current_char
+static void move_to(Lexer *lexer, const char *p)
 {
-    Token *token = malloc(sizeof(Token));
-    token->type = type;
-    token->value = value ? strdup(value) : NULL; // 允许NULL值
+    lexer->pos = (size_t)(p - lexer->source);
+    lexer->current_char = *p;
+}
+
+// 跳过属于class的字节
+static void skip_while(Lexer *lexer, unsigned char class)
+{
+    const char *p = lexer->source + lexer->pos;
+    while (char_class[(unsigned char)*p] & class)
+        p++;
+    move_to(lexer, p);
+}
+
+// 按长度分派的关键字匹配：每个长度最多比较一到两个关键字。
+// start:需要看后面的冒号，由调用者处理
+static TokenType keyword_type(const char *text, size_t length)
+{
+    switch (length)
+    {
+    case 3:
+        if (text[0] == 's' && text[1] == 'a' && text[2] == 'y')
+            return TOKEN_SAY;
+        if (text[0] == 'e' && text[1] == 'n' && text[2] == 'd')
+            return TOKEN_END;
+        break;
+    case 5:
+        if (memcmp(text, "start", 5) == 0)
+            return TOKEN_START;
+        break;
+    case 8:
+        if (memcmp(text, "function", 8) == 0)
+            return TOKEN_FUNCTION;
+        break;
+    }
+    return TOKEN_IDENTIFIER;
+}
+
+// 构造一个指向输入[offset, offset+length)的token
+static Token new_token(TokenType type, size_t offset, size_t length)
+{
+    Token token = {type, offset, length};
     return token;
 }
-Token *next_token(Lexer *lexer)
+
+const char *token_text(const Lexer *lexer, Token token)
 {
-    printf("Current char: %c, pos: %d\n", lexer->current_char, lexer->pos);
+    return lexer->source + (token.offset - lexer->base);
+}
 
-    // 处理待生成的DEDENT
-    if (lexer->pending_dedents > 0)
+// 文件结束：先为剩余的缩进生成DEDENT，最后返回EOF
+static Token end_of_input(Lexer *lexer)
+{
+    if (lexer->indent_top > 0)
     {
-        lexer->pending_dedents--;
-        printf("[LEXER] Generating pending DEDENT (%d left)\n", lexer->pending_dedents);
-        return new_token(TOKEN_DEDENT, NULL);
+        TRACE(TRACE_LEXER, "End of file, generating DEDENT for remaining indent");
+        lexer->indent_top--;
+        lexer->pending_dedents = lexer->indent_top;
+        return new_token(TOKEN_DEDENT, position(lexer), 0);
     }
+    TRACE(TRACE_LEXER, "End of file, returning EOF token");
+    return new_token(TOKEN_EOF, position(lexer), 0);
+}
 
-    // 处理文件结束情况
-    if (lexer->current_char == '\0')
+Token next_token(Lexer *lexer)
+{
+    TRACE(TRACE_LEXER, "Current char: %c, pos: %zu", lexer->current_char, position(lexer));
+
+    // 处理待生成的DEDENT
+    if (lexer->pending_dedents > 0)
     {
-        // 文件结束时处理剩余缩进
-        if (lexer->indent_top > 0)
-        {
-            printf("[LEXER] End of file, generating DEDENT for remaining indent\n");
-            lexer->indent_top--;
-            lexer->pending_dedents = lexer->indent_top;
-            return new_token(TOKEN_DEDENT, NULL);
-        }
-        printf("[LEXER] End of file, returning EOF token\n");
-        return new_token(TOKEN_EOF, NULL);
+        lexer->pending_dedents--;
+        TRACE(TRACE_LEXER, "Generating pending DEDENT (%d left)", lexer->pending_dedents);
+        return new_token(TOKEN_DEDENT, position(lexer), 0);
     }
 
-    while (lexer->current_char != '\0')
+    while (!at_end(lexer))
     {
-        if (lexer->current_char == '#')
+        unsigned char c = (unsigned char)lexer->current_char;
+        if (c == '#')
         {
-            while (lexer->current_char != '\n' && lexer->current_char != '\0')
-            {
-                advance(lexer);
-            }
-            printf("[LEXER] Skipped a comment\n");
+            // 注释的内容不需要保留，窗口可以一直往后滑
+            do
+                move_to(lexer, scan_find(lexer->source + lexer->pos, '\n'));
+            while (lexer->current_char == '\0' && refill(lexer, lexer->pos));
+            TRACE(TRACE_LEXER, "Skipped a comment");
             continue; // 跳过注释后继续处理其他token
         }
         // 处理单字符分隔符
-        switch (lexer->current_char)
+        switch (c)
         {
         case ':': // 冒号
             advance(lexer);
-            return new_token(TOKEN_COLON, ":");
+            return new_token(TOKEN_COLON, position(lexer) - 1, 1);
         case ';': // 分号（如果需要）
             advance(lexer);
-            return new_token(TOKEN_SEMI, ";");
+            return new_token(TOKEN_SEMI, position(lexer) - 1, 1);
         case '\n': // 换行符（已经处理，但为了完整）
             return handle_newline_and_indent(lexer);
         default:
             break;
         }
 
-        if (isspace(lexer->current_char))
+        if (char_class[c] & CC_SPACE)
         {
-            advance(lexer);
+            skip_while(lexer, CC_SPACE);
             continue;
         }
 
-        if (isalpha(lexer->current_char))
+        if (char_class[c] & CC_IDENT_START)
         {
-            char buffer[256];
-            int i = 0;
-            // 允许字母、数字和下划线
-            while (isalnum(lexer->current_char) || lexer->current_char == '_')
-            {
-                if (i < 255)
-                {
-                    buffer[i++] = lexer->current_char;
-                    advance(lexer);
-                }
-                else
-                    // 标识符太长，跳过剩余部分
-                    advance(lexer);
-            }
-            buffer[i] = '\0';
-            printf("Identifier: %s\n", buffer);
-            if (strcmp(buffer, "say") == 0)
-                return new_token(TOKEN_SAY, "say");
-            if (strcmp(buffer, "start") == 0 && lexer->current_char == ':')
+            size_t start = position(lexer);
+            // 允许字母、数字和下划线；标识符跨过窗口末尾时从它的开头保留
+            do
+                skip_while(lexer, CC_IDENT);
+            while (lexer->current_char == '\0' && refill(lexer, start - lexer->base));
+            size_t length = position(lexer) - start;
+            const char *text = lexer->source + (start - lexer->base);
+            TRACE(TRACE_LEXER, "Identifier: %.*s", (int)length, text);
+            TokenType type = keyword_type(text, length);
+            if (type == TOKEN_START)
             {
+                if (lexer->current_char != ':')
+                    return new_token(TOKEN_IDENTIFIER, start, length);
                 advance(lexer);
-                return new_token(TOKEN_START, "start:");
+                return new_token(TOKEN_START, start, length + 1);
             }
-            // 检查函数关键字
-            if (strcmp(buffer, "function") == 0)
-                return new_token(TOKEN_FUNCTION, "function");
-            if (strcmp(buffer, "end") == 0)
-                return new_token(TOKEN_END, "end");
-            return new_token(TOKEN_IDENTIFIER, buffer);
+            return new_token(type, start, length);
         }
 
-        if (lexer->current_char == '"')
+        if (c == '"')
         {
             advance(lexer);
-            char buffer[256];
-            int i = 0;
-            while (lexer->current_char != '"' && lexer->current_char != '\0')
-            {
-                buffer[i++] = lexer->current_char;
-                advance(lexer);
-            }
+            // 字符串不再复制到定长缓冲区，token直接引用源码中引号之间的部分
+            size_t start = position(lexer);
+            do
+                move_to(lexer, scan_find(lexer->source + lexer->pos, '"'));
+            while (lexer->current_char == '\0' && refill(lexer, start - lexer->base));
+            size_t length = position(lexer) - start;
             if (lexer->current_char == '"')
                 advance(lexer);
-            buffer[i] = '\0';
-            return new_token(TOKEN_STRING, buffer);
+            return new_token(TOKEN_STRING, start, length);
         }
 
-        Token *unknown = new_token(TOKEN_UNKNOWN, (char[]){lexer->current_char, '\0'});
+        Token unknown = new_token(TOKEN_UNKNOWN, position(lexer), 1);
         advance(lexer);
         return unknown;
     }
 
     // 文件结束时处理剩余缩进
-    if (lexer->indent_top > 0)
-    {
-        lexer->indent_top--;
-        lexer->pending_dedents = lexer->indent_top;
-        return new_token(TOKEN_DEDENT, NULL);
-    }
-    return new_token(TOKEN_EOF, "");
+    return end_of_input(lexer);
 }
 
 // 处理换行和缩进
-Token *handle_newline_and_indent(Lexer *lexer)
+Token handle_newline_and_indent(Lexer *lexer)
 {
     // 跳过当前换行符
     if (lexer->current_char == '\n')
@@ -163,37 +337,35 @@ Token *handle_newline_and_indent(Lexer *lexer)
     }
 
     // 检查是否到达EOF
-    if (lexer->current_char == '\0')
+    if (at_end(lexer))
     {
-        printf("[LEXER] End of file after newline, no token generated\n");
-        return NULL;
+        TRACE(TRACE_LEXER, "End of file after newline");
+        return end_of_input(lexer);
     }
 
-    int new_indent = 0;
+    // 计算当前行的缩进：空格和制表符都算一格
+    size_t line_start = position(lexer);
+    do
+        move_to(lexer, scan_skip_blanks(lexer->source + lexer->pos));
+    while (lexer->current_char == '\0' && refill(lexer, line_start - lexer->base));
+    int new_indent = (int)(position(lexer) - line_start);
 
-    // 计算当前行的缩进
-    while (lexer->current_char == ' ' || lexer->current_char == '\t')
+    // 检查是否到达文件尾
+    if (new_indent > 0 && lexer->current_char == '\0')
     {
-        new_indent++;
-        advance(lexer);
-
-        // 检查是否到达行尾或文件尾
-        if (lexer->current_char == '\0')
-        {
-            printf("[LEXER] End of file during indentation calculation, no token generated\n");
-            return NULL;
-        }
+        TRACE(TRACE_LEXER, "End of file during indentation calculation");
+        return end_of_input(lexer);
     }
 
     // 添加调试信息
-    printf("[LEXER] Newline: new_indent=%d, current_indent_stack=%d\n",
-           new_indent, lexer->indent_stack[lexer->indent_top]);
+    TRACE(TRACE_LEXER, "Newline: new_indent=%d, current_indent_stack=%d",
+          new_indent, lexer->indent_stack[lexer->indent_top]);
 
     // 如果遇到连续换行符或文件结束
     if (lexer->current_char == '\n' || lexer->current_char == '\0')
     {
-        printf("[LEXER] Newline without content, returning NEWLINE token\n");
-        return new_token(TOKEN_NEWLINE, NULL);
+        TRACE(TRACE_LEXER, "Newline without content, returning NEWLINE token");
+        return new_token(TOKEN_NEWLINE, position(lexer), 0);
     }
 
     int current_indent = lexer->indent_stack[lexer->indent_top];
@@ -201,9 +373,8 @@ Token *handle_newline_and_indent(Lexer *lexer)
     // 处理缩进级别变化
     if (new_indent > current_indent)
     {
-        lexer->indent_top++;
-        lexer->indent_stack[lexer->indent_top] = new_indent;
-        return new_token(TOKEN_INDENT, NULL);
+        push_indent(lexer, new_indent);
+        return new_token(TOKEN_INDENT, position(lexer), 0);
     }
     else if (new_indent < current_indent)
     {
@@ -224,10 +395,10 @@ Token *handle_newline_and_indent(Lexer *lexer)
             lexer->pending_dedents = levels_to_dedent - 1;
         }
 
-        return new_token(TOKEN_DEDENT, NULL);
+        return new_token(TOKEN_DEDENT, position(lexer), 0);
     }
     else
     {
-        return new_token(TOKEN_NEWLINE, NULL);
+        return new_token(TOKEN_NEWLINE, position(lexer), 0);
     }
 }
\ No newline at end of file
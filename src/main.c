@@ -1,155 +1,259 @@
 #include <stdlib.h>
 #include <string.h>
-#include "lexer.h"
-#include "parser.h"
-#include "codegen.h"
-#include "ast.h"
+#include "driver.h"
+#include "batch.h"
+#include "watch.h"
+#include "server.h"
+#include "threadpool.h"
+#include "trace.h"
+#include <signal.h>
 
-char *read_file(const char *filename)
+int main(int argc, char *argv[])
 {
-    FILE *file = fopen(filename, "rb");
-    if (!file)
+    // 解析命令行：以--开头的是选项，其余依次是源文件和输出文件
+    const char *source_path = NULL;
+    const char *output_arg = NULL;
+    const char *emit_c_path = NULL; // 默认通过管道把C代码交给gcc，不落盘
+    int show_stats = 0;
+    int use_cache = 0;
+    int show_cache_stats = 0;
+    const char *cache_dir = NULL;
+    unsigned long long cache_size = CACHE_DEFAULT_MAX_BYTES;
+    PreludeMode prelude = PRELUDE_PCH;
+    Backend backend = BACKEND_C;
+    const char *manifest_path = NULL;
+    int jobs = 0; // 0表示使用CPU数
+    int run = 0;
+    int watch = 0;
+    const char *server_path = NULL;
+    const char *client_path = NULL;
+    int time_report = 0; // 1为文本，2为JSON
+    int split = 0;
+    const char *server_option = NULL; // 只对本进程编译有效的选项，客户端模式下要拒绝
+    OptLevel opt_level = OPT_BASIC;
+    for (int i = 1; i < argc; i++)
     {
-        perror("File opening failed");
-        return NULL;
+        if (strcmp(argv[i], "--stats") == 0)
+            show_stats = 1;
+        else if (strncmp(argv[i], "--emit-c=", 9) == 0)
+            emit_c_path = argv[i] + 9;
+        else if (strcmp(argv[i], "-O0") == 0)
+            opt_level = OPT_NONE;
+        else if (strcmp(argv[i], "-O1") == 0)
+            opt_level = OPT_BASIC;
+        else if (strcmp(argv[i], "-O2") == 0)
+            opt_level = OPT_FULL;
+        else if (strcmp(argv[i], "--run") == 0)
+            run = 1;
+        else if (strcmp(argv[i], "--watch") == 0)
+            watch = 1;
+        else if (strncmp(argv[i], "--split=", 8) == 0)
+        {
+            server_option = argv[i];
+            split = atoi(argv[i] + 8);
+            if (split < 2 || split > 256)
+            {
+                fprintf(stderr, "--split expects between 2 and 256 translation units\n");
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--time-report") == 0)
+            time_report = 1;
+        else if (strcmp(argv[i], "--time-report=json") == 0)
+            time_report = 2;
+        else if (strcmp(argv[i], "--server") == 0 && i + 1 < argc)
+            server_path = argv[++i];
+        else if (strncmp(argv[i], "--server=", 9) == 0)
+            server_path = argv[i] + 9;
+        else if (strcmp(argv[i], "--client") == 0 && i + 1 < argc)
+            client_path = argv[++i];
+        else if (strncmp(argv[i], "--client=", 9) == 0)
+            client_path = argv[i] + 9;
+        else if (strcmp(argv[i], "--cache") == 0)
+        {
+            server_option = argv[i];
+            use_cache = 1;
+        }
+        else if (strncmp(argv[i], "--cache-dir=", 12) == 0)
+        {
+            server_option = argv[i];
+            use_cache = 1;
+            cache_dir = argv[i] + 12;
+        }
+        else if (strncmp(argv[i], "--cache-size=", 13) == 0)
+        {
+            server_option = argv[i];
+            cache_size = strtoull(argv[i] + 13, NULL, 10) * 1024 * 1024; // 单位MiB
+        }
+        else if (strcmp(argv[i], "--cache-stats") == 0)
+        {
+            server_option = argv[i];
+            show_cache_stats = 1;
+        }
+        else if (strcmp(argv[i], "--backend=c") == 0)
+            backend = BACKEND_C;
+        else if (strcmp(argv[i], "--backend=native") == 0)
+            backend = BACKEND_NATIVE;
+        else if (strncmp(argv[i], "--prelude=", 10) == 0)
+        {
+            server_option = argv[i];
+            if (strcmp(argv[i] + 10, "full") == 0)
+                prelude = PRELUDE_FULL;
+            else if (strcmp(argv[i] + 10, "pch") == 0)
+                prelude = PRELUDE_PCH;
+            else if (strcmp(argv[i] + 10, "minimal") == 0)
+                prelude = PRELUDE_MINIMAL;
+            else
+            {
+                fprintf(stderr, "Unknown option: %s\n", argv[i]);
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc)
+            manifest_path = argv[++i];
+        else if (strncmp(argv[i], "--batch=", 8) == 0)
+            manifest_path = argv[i] + 8;
+        else if (strcmp(argv[i], "-j") == 0 && i + 1 < argc)
+            jobs = atoi(argv[++i]);
+        else if (strncmp(argv[i], "-j", 2) == 0 && argv[i][2] != '\0')
+            jobs = atoi(argv[i] + 2);
+        else if (strncmp(argv[i], "--jobs=", 7) == 0)
+            jobs = atoi(argv[i] + 7);
+        else if (strncmp(argv[i], "--trace=", 8) == 0)
+        {
+            if (trace_parse(argv[i] + 8) != 0)
+            {
+                fprintf(stderr, "Unknown trace category in %s (expected lexer, parser, codegen, driver or all)\n", argv[i]);
+                return 1;
+            }
+#ifdef HERCODE_NO_TRACE
+            fprintf(stderr, "Warning: tracing was compiled out of this build, %s ignored\n", argv[i]);
+#endif
+        }
+        else if (argv[i][0] == '-' && argv[i][1] != '\0')
+        {
+            fprintf(stderr, "Unknown option: %s\n", argv[i]);
+            return 1;
+        }
+        else if (!source_path)
+            source_path = argv[i];
+        else if (!output_arg)
+            output_arg = argv[i];
     }
 
-    fseek(file, 0, SEEK_END);
-    long size = ftell(file);
-    fseek(file, 0, SEEK_SET);
-
-    char *buffer = malloc(size + 1);
-    fread(buffer, 1, size, file);
-    buffer[size] = '\0';
-    fclose(file);
-    return buffer;
-}
-
-void separate_header(const char *source, const char *magic_string,
-                     char **c_header, char **hercode_source)
-{
-    *c_header = NULL;
-    *hercode_source = NULL;
-
-    char *magic_pos = strstr(source, magic_string);
-    if (magic_pos == NULL)
+    if (manifest_path && emit_c_path)
     {
-        return; // 没有找到特殊字符串
+        fprintf(stderr, "--emit-c cannot be used with --batch\n");
+        return 1;
     }
-
-    // 确保特殊字符串在行首
-    if (magic_pos != source)
+    if (run && (manifest_path || emit_c_path))
     {
-        char *prev_char = magic_pos - 1;
-        if (*prev_char != '\n' && *prev_char != '\r')
-        {
-            return; // 不在行首
-        }
+        fprintf(stderr, "--run cannot be used with --batch or --emit-c\n");
+        return 1;
     }
-
-    // 查找行结束位置
-    char *line_end = strchr(magic_pos, '\n');
-    if (line_end == NULL)
+    if (watch && (manifest_path || emit_c_path || run))
     {
-        // 如果没有换行符，特殊字符串后没有内容
-        size_t header_size = magic_pos - source;
-        *c_header = malloc(header_size + 1);
-        if (*c_header)
-        {
-            strncpy(*c_header, source, header_size);
-            (*c_header)[header_size] = '\0';
-        }
-        *hercode_source = ""; // 空字符串
-        return;
+        fprintf(stderr, "--watch cannot be used with --batch, --emit-c or --run\n");
+        return 1;
     }
 
-    // 计算C头部分的大小
-    size_t header_size = magic_pos - source;
-    *c_header = malloc(header_size + 1);
-    if (*c_header)
+    if ((server_path || client_path) && (manifest_path || emit_c_path || run || watch))
     {
-        strncpy(*c_header, source, header_size);
-        (*c_header)[header_size] = '\0';
+        fprintf(stderr, "--server and --client cannot be used with --batch, --emit-c, --run or --watch\n");
+        return 1;
     }
-
-    // HerCode部分从下一行开始
-    *hercode_source = line_end + 1;
-
-    // 特殊处理CRLF换行
-    if (*line_end == '\n' && line_end > magic_pos && *(line_end - 1) == '\r')
+    if (split && (emit_c_path || run || watch))
     {
-        // 如果前面有CR，跳过它
-        *hercode_source = line_end;
+        fprintf(stderr, "--split cannot be used with --emit-c, --run or --watch\n");
+        return 1;
     }
-}
-
-int main(int argc, char *argv[])
-{
-    if (argc < 2)
+    if (source_path && strcmp(source_path, "-") == 0 && (watch || client_path))
     {
-        fprintf(stderr, "Usage: %s <source_file> [output_name]\n", argv[0]);
+        fprintf(stderr, "Reading the program from standard input (-) cannot be used with --watch or --client\n");
         return 1;
     }
-
-    // 读取整个文件
-    char *source = read_file(argv[1]);
-    if (!source)
+    if (time_report && (manifest_path || watch || server_path || client_path))
     {
-        fprintf(stderr, "Error reading file: %s\n", argv[1]);
+        fprintf(stderr, "--time-report only works when compiling a single file\n");
+        return 1;
+    }
+    // 缓存、prelude和拆分由服务器启动时的选项决定，客户端的请求里没有这些字段
+    if (client_path && server_option)
+    {
+        fprintf(stderr, "%s cannot be used with --client; pass it to --server instead\n", server_option);
+        return 1;
+    }
+    if (server_path && client_path)
+    {
+        fprintf(stderr, "--server and --client cannot be used together\n");
         return 1;
     }
 
-    // 尝试分离C头部分
-    char *c_header = NULL;
-    char *hercode_source = NULL;
-    separate_header(source, "Hello! Her World", &c_header, &hercode_source);
-    printf("C Code:\n%s\n", c_header);
-    // 验证分离结果
-    if (hercode_source == NULL)
-        hercode_source = source; // 如果分离失败，使用整个文件
+    // gcc提前退出或对方关闭连接时不要被SIGPIPE杀掉，由写入方报告失败
+    signal(SIGPIPE, SIG_IGN);
 
-    // 输出分离结果用于调试
-    printf("HerCode Source to Parse:\n%s\n", hercode_source);
+    // 客户端只转发请求，编译和缓存都在服务器进程里
+    CompileOptions options = {0};
+    options.backend = backend;
+    options.opt_level = opt_level;
+    options.show_stats = show_stats;
+    if (client_path && source_path)
+        return run_client(client_path, source_path, output_arg ? output_arg : "a.out", &options);
 
-    // 创建词法分析器和解析器
-    Lexer *lexer = new_lexer(hercode_source);
-    Parser *parser = new_parser(lexer);
+    // 构建缓存和预编译prelude共用同一个缓存目录
+    BuildCache cache;
+    // --split时目标文件也缓存在这里
+    int have_cache = (use_cache || show_cache_stats || split || (prelude == PRELUDE_PCH && !run)) &&
+                     cache_open(&cache, cache_dir, cache_size) == 0;
 
-    // 解析程序
-    int node_count;
-    ASTNode **nodes = parse_program(parser, &node_count);
-    printf("Parsed %d nodes\n", node_count);
+    options.emit_c_path = emit_c_path;
+    options.prelude = prelude;
+    options.cache = have_cache ? &cache : NULL;
+    options.use_cache = use_cache;
+    options.run = run;
+    // batch和服务器模式已经按文件并行，单个文件编译时-j用来并行生成C代码
+    options.split_units = split;
+    options.codegen_jobs = manifest_path || server_path ? 1 : (jobs > 0 ? jobs : cpu_count());
+    TimeReport report = {0};
+    if (time_report)
+        options.time_report = &report;
 
-    // 生成C代码
-    FILE *c_file = fopen("temp.c", "w");
-    if (!c_file)
+    if (!source_path && !manifest_path && !server_path)
     {
-        perror("Error creating C file");
+        // 只查询缓存统计时不需要源文件
+        if (show_cache_stats && have_cache)
+        {
+            cache_print_stats(&cache, stdout);
+            return 0;
+        }
+        fprintf(stderr, "Usage: %s [options] <source_file> [output_name]\n"
+                        "       %s [options] --run <source_file>\n"
+                        "       %s [options] --watch <source_file> [output_name]\n"
+                        "       %s [options] --batch manifest.txt [-j N]\n"
+                        "       %s [options] --server socket [-j N]\n"
+                        "       %s [-O0|-O1|-O2] [--stats] [--backend=c|native] --client socket <source_file> [output_name]\n"
+                        "Options: [-O0|-O1|-O2] [-j N] [--stats] [--time-report[=json]] [--trace=lexer,parser,codegen] [--emit-c=file.c]\n"
+                        "         [--cache] [--cache-dir=dir] [--cache-size=MiB] [--cache-stats]\n"
+                        "         [--prelude=full|pch|minimal] [--backend=c|native] [--split=K]\n",
+                argv[0], argv[0], argv[0], argv[0], argv[0], argv[0]);
         return 1;
     }
-    generate_c_code(c_header, nodes, node_count, c_file);
-    fclose(c_file);
 
-    // 编译
-    char output_name[256] = "a.out";
-    if (argc >= 3)
-    {
-        strncpy(output_name, argv[2], sizeof(output_name) - 1);
-    }
-    compile("temp.c", output_name);
-
-    // 清理
-    if (c_header)
-        free(c_header);
-    free(source);
-    free_parser(parser);
+    driver_prepare(&options);
 
-    for (int i = 0; i < node_count; i++)
-    {
-        free_node(nodes[i]);
-    }
-    free(nodes);
+    int status;
+    if (server_path)
+        status = run_server(server_path, jobs > 0 ? jobs : cpu_count(), &options);
+    else if (watch)
+        status = watch_file(source_path, output_arg ? output_arg : "a.out", &options);
+    else if (manifest_path)
+        status = compile_batch(manifest_path, jobs > 0 ? jobs : cpu_count(), &options);
+    else
+        status = compile_file(source_path, output_arg ? output_arg : "a.out", &options, stderr);
+    if (time_report)
+        time_report_print(&report, source_path, time_report == 2, stderr);
 
-    printf("Successfully generated: %s\n", output_name);
-    return 0;
-}
\ No newline at end of file
+    if (show_cache_stats && have_cache)
+        cache_print_stats(&cache, stdout);
+    return status;
+}
@@ -0,0 +1,368 @@
+#include "optimize.h"
+#include "symtab.h"
+#include "trace.h"
+#include <ctype.h>
+#include <string.h>
+
+// 调用目标：函数表下标，或者下面两个特殊值
+#define TARGET_NONE -1     // 不是函数调用
+#define TARGET_EXTERNAL -2 // C头里定义的function_<name>
+
+typedef struct
+{
+    ASTNode *def;   // 第一次定义
+    ASTNode **body; // 内联之后的函数体
+    int body_count;
+    int *targets; // 和body一一对应的调用目标
+    int reachable;
+    int recursive;
+    int header_root; // C头里引用了function_<name>
+    // Tarjan强连通分量算法用的状态
+    int index;
+    int lowlink;
+    int on_stack;
+    int next_edge; // 下一条要看的调用边
+} FunctionInfo;
+
+typedef struct
+{
+    FunctionInfo *functions;
+    int function_count;
+    SymbolTable symbols; // 函数名 -> FunctionInfo*
+    Arena *arena;
+    // Tarjan；调用链可能有几十万层，深度优先遍历用显式的栈，不用C递归
+    int *stack;
+    int stack_top;
+    int *calls; // 遍历路径上的函数
+    int *worklist; // mark_reachable的待处理函数
+    int next_index;
+    int *order; // 强连通分量的完成顺序，也就是被调用者在前的拓扑序
+    int order_count;
+} CallGraph;
+
+static int lookup(const CallGraph *graph, const char *name, size_t length)
+{
+    Symbol *symbol = symtab_lookup(&graph->symbols, name, length);
+    return symbol ? (int)((FunctionInfo *)symbol->value - graph->functions) : TARGET_NONE;
+}
+
+// C头里是否以完整标识符的形式出现了function_<name>
+static int header_mentions(const char *c_header, const char *name, size_t length)
+{
+    if (!c_header)
+        return 0;
+    static const char prefix[] = "function_";
+    const size_t prefix_length = sizeof(prefix) - 1;
+    for (const char *p = strstr(c_header, prefix); p; p = strstr(p + 1, prefix))
+    {
+        if (p > c_header && (isalnum((unsigned char)p[-1]) || p[-1] == '_'))
+            continue;
+        const char *q = p + prefix_length;
+        if (strncmp(q, name, length) == 0 && !(isalnum((unsigned char)q[length]) || q[length] == '_'))
+            return 1;
+    }
+    return 0;
+}
+
+// 解析一段语句里的调用目标；有未定义的函数时返回-1
+static int resolve_calls(CallGraph *graph, ASTNode **body, int body_count, int *targets,
+                         const char *c_header, const char *caller, size_t caller_length,
+                         const char *filename, FILE *diag)
+{
+    int status = 0;
+    for (int i = 0; i < body_count; i++)
+    {
+        targets[i] = TARGET_NONE;
+        if (body[i]->type != STMT_FUNCTION_CALL)
+            continue;
+        targets[i] = lookup(graph, body[i]->value, body[i]->length);
+        if (targets[i] != TARGET_NONE)
+            continue;
+        if (header_mentions(c_header, body[i]->value, body[i]->length))
+        {
+            targets[i] = TARGET_EXTERNAL;
+            continue;
+        }
+        if (caller)
+            fprintf(diag, "%s: Error: call to undefined function '%.*s' in function '%.*s'\n", filename,
+                    (int)body[i]->length, body[i]->value, (int)caller_length, caller);
+        else
+            fprintf(diag, "%s: Error: call to undefined function '%.*s' in start:\n", filename,
+                    (int)body[i]->length, body[i]->value);
+        status = -1;
+    }
+    return status;
+}
+
+static void visit(CallGraph *graph, int v)
+{
+    FunctionInfo *f = &graph->functions[v];
+    f->index = f->lowlink = graph->next_index++;
+    f->next_edge = 0;
+    graph->stack[graph->stack_top++] = v;
+    f->on_stack = 1;
+}
+
+static void strong_connect(CallGraph *graph, int root)
+{
+    int depth = 0;
+    visit(graph, root);
+    graph->calls[depth++] = root;
+    while (depth > 0)
+    {
+        int v = graph->calls[depth - 1];
+        FunctionInfo *f = &graph->functions[v];
+        if (f->next_edge < f->body_count)
+        {
+            int w = f->targets[f->next_edge++];
+            if (w < 0)
+                continue;
+            if (w == v)
+                f->recursive = 1; // 直接调用自己
+            FunctionInfo *g = &graph->functions[w];
+            if (g->index < 0)
+            {
+                // 相当于递归调用strong_connect(w)，返回时再更新lowlink
+                visit(graph, w);
+                graph->calls[depth++] = w;
+            }
+            else if (g->on_stack && g->index < f->lowlink)
+                f->lowlink = g->index;
+            continue;
+        }
+
+        // v的边都看完了，回到调用者
+        depth--;
+        if (depth > 0)
+        {
+            FunctionInfo *caller = &graph->functions[graph->calls[depth - 1]];
+            if (f->lowlink < caller->lowlink)
+                caller->lowlink = f->lowlink;
+        }
+        if (f->lowlink != f->index)
+            continue;
+        // v是一个强连通分量的根，弹出整个分量；多于一个函数的分量里全是递归函数
+        int top = graph->stack_top;
+        int w;
+        do
+        {
+            w = graph->stack[--graph->stack_top];
+            graph->functions[w].on_stack = 0;
+            graph->order[graph->order_count++] = w;
+        } while (w != v);
+        if (top - graph->stack_top > 1)
+        {
+            for (int i = graph->stack_top; i < top; i++)
+                graph->functions[graph->stack[i]].recursive = 1;
+        }
+    }
+}
+
+// 从targets出发标记能到达的函数；每个函数最多进一次工作栈
+static void mark_reachable(CallGraph *graph, const int *targets, int count)
+{
+    int top = 0;
+    for (int i = 0; i < count; i++)
+    {
+        int w = targets[i];
+        if (w < 0 || graph->functions[w].reachable)
+            continue;
+        graph->functions[w].reachable = 1;
+        graph->worklist[top++] = w;
+    }
+    while (top > 0)
+    {
+        FunctionInfo *f = &graph->functions[graph->worklist[--top]];
+        for (int i = 0; i < f->body_count; i++)
+        {
+            int w = f->targets[i];
+            if (w < 0 || graph->functions[w].reachable)
+                continue;
+            graph->functions[w].reachable = 1;
+            graph->worklist[top++] = w;
+        }
+    }
+}
+
+static void compute_reachability(CallGraph *graph, const int *main_targets, int main_count)
+{
+    for (int i = 0; i < graph->function_count; i++)
+        graph->functions[i].reachable = 0;
+    for (int i = 0; i < graph->function_count; i++)
+    {
+        if (graph->functions[i].header_root && !graph->functions[i].reachable)
+        {
+            graph->functions[i].reachable = 1;
+            mark_reachable(graph, graph->functions[i].targets, graph->functions[i].body_count);
+        }
+    }
+    mark_reachable(graph, main_targets, main_count);
+}
+
+static int can_inline(const CallGraph *graph, int target)
+{
+    return target >= 0 && !graph->functions[target].recursive &&
+           graph->functions[target].body_count <= INLINE_MAX_STATEMENTS;
+}
+
+// 把一段语句里对小函数的调用替换成函数体（函数体已经内联过，所以只需展开一层）
+static void inline_calls(CallGraph *graph, ASTNode ***body, int *body_count, int **targets, int *inlined)
+{
+    int new_count = 0;
+    int any = 0;
+    for (int i = 0; i < *body_count; i++)
+    {
+        int t = (*targets)[i];
+        any |= can_inline(graph, t);
+        new_count += can_inline(graph, t) ? graph->functions[t].body_count : 1;
+    }
+    if (!any)
+        return;
+
+    ASTNode **new_body = arena_alloc(graph->arena, (new_count + 1) * sizeof(ASTNode *));
+    int *new_targets = arena_alloc(graph->arena, (new_count + 1) * sizeof(int));
+    int n = 0;
+    for (int i = 0; i < *body_count; i++)
+    {
+        int t = (*targets)[i];
+        if (!can_inline(graph, t))
+        {
+            new_body[n] = (*body)[i];
+            new_targets[n++] = t;
+            continue;
+        }
+        // AST节点不会被修改，可以直接共享
+        FunctionInfo *callee = &graph->functions[t];
+        memcpy(new_body + n, callee->body, callee->body_count * sizeof(ASTNode *));
+        memcpy(new_targets + n, callee->targets, callee->body_count * sizeof(int));
+        n += callee->body_count;
+        (*inlined)++;
+    }
+    *body = new_body;
+    *body_count = n;
+    *targets = new_targets;
+}
+
+int optimize_program(ASTNode ***nodes, int *count, const char *c_header, OptLevel level,
+                     Arena *arena, const char *filename, FILE *diag, OptimizeStats *stats)
+{
+    memset(stats, 0, sizeof(*stats));
+
+    // 收集函数定义和顶层语句
+    CallGraph graph;
+    memset(&graph, 0, sizeof(graph));
+    graph.arena = arena;
+    graph.functions = arena_alloc(arena, (*count + 1) * sizeof(FunctionInfo));
+    symtab_init(&graph.symbols, arena, *count);
+    ASTNode **main_body = arena_alloc(arena, (*count + 1) * sizeof(ASTNode *));
+    int main_count = 0;
+    for (int i = 0; i < *count; i++)
+    {
+        ASTNode *node = (*nodes)[i];
+        if (node->type != STMT_FUNCTION_DEF)
+        {
+            main_body[main_count++] = node;
+            continue;
+        }
+        Symbol *symbol = symtab_intern(&graph.symbols, node->value, node->length);
+        if (symbol->value)
+            continue;
+        FunctionInfo *f = &graph.functions[graph.function_count++];
+        memset(f, 0, sizeof(*f));
+        symbol->value = f;
+        f->def = node;
+        f->body = node->body;
+        f->body_count = node->body_count;
+        f->header_root = header_mentions(c_header, node->value, node->length);
+        f->index = -1;
+    }
+    int definition_count = *count - main_count; // 包括重复定义
+
+    // 调用图的边
+    int status = 0;
+    int *main_targets = arena_alloc(arena, (main_count + 1) * sizeof(int));
+    if (resolve_calls(&graph, main_body, main_count, main_targets, c_header, NULL, 0, filename, diag) != 0)
+        status = -1;
+    for (int i = 0; i < graph.function_count; i++)
+    {
+        FunctionInfo *f = &graph.functions[i];
+        f->targets = arena_alloc(arena, (f->body_count + 1) * sizeof(int));
+        if (resolve_calls(&graph, f->body, f->body_count, f->targets, c_header,
+                          f->def->value, f->def->length, filename, diag) != 0)
+            status = -1;
+    }
+    if (status != 0)
+        return -1;
+    // -O0只检查未定义的函数
+    if (level == OPT_NONE)
+        return 0;
+
+    // 递归检测；HerCode没有条件语句，到得了的递归一定不会结束
+    graph.stack = arena_alloc(arena, (graph.function_count + 1) * sizeof(int));
+    graph.order = arena_alloc(arena, (graph.function_count + 1) * sizeof(int));
+    graph.calls = arena_alloc(arena, (graph.function_count + 1) * sizeof(int));
+    graph.worklist = arena_alloc(arena, (graph.function_count + 1) * sizeof(int));
+    for (int i = 0; i < graph.function_count; i++)
+    {
+        if (graph.functions[i].index < 0)
+            strong_connect(&graph, i);
+    }
+    compute_reachability(&graph, main_targets, main_count);
+    for (int i = 0; i < graph.function_count; i++)
+    {
+        FunctionInfo *f = &graph.functions[i];
+        if (!f->recursive || !f->reachable)
+            continue;
+        stats->recursive_functions++;
+        fprintf(diag, "%s: Warning: function '%.*s' is recursive and will never return\n",
+                filename, (int)f->def->length, f->def->value);
+    }
+
+    if (level >= OPT_FULL)
+    {
+        // 按拓扑序处理，被调用者先完成内联
+        for (int i = 0; i < graph.order_count; i++)
+        {
+            FunctionInfo *f = &graph.functions[graph.order[i]];
+            inline_calls(&graph, &f->body, &f->body_count, &f->targets, &stats->calls_inlined);
+        }
+        inline_calls(&graph, &main_body, &main_count, &main_targets, &stats->calls_inlined);
+        // 内联之后有些函数不再被调用
+        compute_reachability(&graph, main_targets, main_count);
+    }
+
+    // 重新组装顶层节点：函数定义保持原来的顺序，语句用内联后的main。
+    // 内联可能让main比原来的顶层节点多得多，所以按内联后的长度分配
+    ASTNode **result = arena_alloc(arena, (definition_count + main_count + 1) * sizeof(ASTNode *));
+    int n = 0;
+    for (int i = 0; i < *count; i++)
+    {
+        ASTNode *node = (*nodes)[i];
+        if (node->type != STMT_FUNCTION_DEF)
+            continue;
+        int index = lookup(&graph, node->value, node->length);
+        FunctionInfo *f = &graph.functions[index];
+        if (f->def != node)
+        {
+            result[n++] = node; // 重复定义，解析器已经报过错，这里原样保留
+            continue;
+        }
+        if (!f->reachable)
+        {
+            TRACE(TRACE_CODEGEN, "removing unreachable function %.*s", (int)node->length, node->value);
+            stats->functions_removed++;
+            continue;
+        }
+        if (f->body != node->body)
+            node = create_function_def_node(arena, node->value, node->length, f->body, f->body_count);
+        result[n++] = node;
+    }
+    for (int i = 0; i < main_count; i++)
+        result[n++] = main_body[i];
+
+    TRACE(TRACE_CODEGEN, "optimizer: %d functions removed, %d calls inlined",
+          stats->functions_removed, stats->calls_inlined);
+    *nodes = result;
+    *count = n;
+    return 0;
+}
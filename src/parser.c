@@ -1,9 +1,32 @@
 #include "parser.h"
+#include "trace.h"
+#include <stdarg.h>
 #include <stdlib.h>
-#include <stdio.h>
 #include <string.h>
 
-#define MAX_STATEMENTS 100
+// 语句列表：从arena分配，满了容量翻倍。旧数组留在arena里，
+// 所以一个列表总共占用的内存不超过最终大小的2倍
+typedef struct
+{
+    ASTNode **items;
+    int count;
+    int capacity;
+} NodeList;
+
+static void node_list_push(Arena *arena, NodeList *list, ASTNode *node)
+{
+    if (list->count == list->capacity)
+    {
+        int capacity = list->capacity ? list->capacity * 2 : 16;
+        ASTNode **grown = arena_alloc(arena, capacity * sizeof(ASTNode *));
+        if (list->count)
+            memcpy(grown, list->items, list->count * sizeof(ASTNode *));
+        list->items = grown;
+        list->capacity = capacity;
+    }
+    list->items[list->count++] = node;
+}
+
 const char *token_type_to_string(TokenType type)
 {
     switch (type)
@@ -18,6 +41,8 @@ const char *token_type_to_string(TokenType type)
         return "STRING";
     case TOKEN_SEMI:
         return "SEMI";
+    case TOKEN_START:
+        return "START";
     case TOKEN_END:
         return "END";
     case TOKEN_NEWLINE:
@@ -39,71 +64,96 @@ const char *token_type_to_string(TokenType type)
 
 Parser *new_parser(Lexer *lexer)
 {
-    Parser *parser = malloc(sizeof(Parser));
+    Parser *parser = arena_alloc(lexer->arena, sizeof(Parser));
     parser->lexer = lexer;
     parser->current_token = next_token(lexer);
     parser->current_indent = 0; // 初始缩进深度为0
+    parser->diag = stderr;
+    parser->filename = NULL;
+    parser->first_line = 1;
+    symtab_init(&parser->functions, lexer->arena, 0);
     return parser;
 }
 
-void free_parser(Parser *parser)
+// 根据token的位置算出行号，只在出错和定义函数时才需要
+static int token_line(Parser *parser, Token token)
 {
-    free_token(parser->current_token);
-    free(parser->lexer);
-    free(parser);
+    return parser->first_line + lexer_line(parser->lexer, token.offset);
 }
 
-void free_token(Token *token)
+// 流式输入时token的文本在下一次next_token之后就可能被覆盖，要在eat之前复制到arena
+static const char *stable_text(Parser *parser, Token token)
 {
-    if (token)
-    {
-        free(token->value);
-        free(token);
-    }
+    const char *text = token_text(parser->lexer, token);
+    if (!lexer_is_streaming(parser->lexer))
+        return text;
+    return arena_strndup(parser->lexer->arena, text, token.length);
+}
+
+// 驻留函数名；第一次出现的名字在流式输入时复制一份
+static Symbol *intern_name(Parser *parser, Token name)
+{
+    const char *text = token_text(parser->lexer, name);
+    Symbol *symbol = symtab_intern(&parser->functions, text, name.length);
+    if (symbol->name == text && lexer_is_streaming(parser->lexer))
+        symbol->name = arena_strndup(parser->lexer->arena, text, name.length);
+    return symbol;
+}
+
+void parser_error(Parser *parser, const char *format, ...)
+{
+    int line = token_line(parser, parser->current_token);
+
+    if (parser->filename)
+        fprintf(parser->diag, "%s:%d: ", parser->filename, line);
+    va_list args;
+    va_start(args, format);
+    vfprintf(parser->diag, format, args);
+    va_end(args);
+    fputc('\n', parser->diag);
+    longjmp(parser->error_jump, 1);
 }
 
 void eat(Parser *parser, TokenType type)
 {
-    if (parser->current_token->type == type)
+    if (parser->current_token.type == type)
     {
-        free_token(parser->current_token);
         parser->current_token = next_token(parser->lexer);
     }
     else
     {
-        printf("Syntax error: Expected token type %d (%s), but got token type %d (%s)\n",
-               type, token_type_to_string(type), parser->current_token->type, token_type_to_string(parser->current_token->type));
-        exit(1);
+        parser_error(parser, "Syntax error: Expected token type %d (%s), but got token type %d (%s)",
+                    type, token_type_to_string(type), parser->current_token.type, token_type_to_string(parser->current_token.type));
     }
 }
 ASTNode *parse_statement(Parser *parser)
 {
     // 跳过无关token
-    while (parser->current_token->type == TOKEN_DEDENT ||
-           parser->current_token->type == TOKEN_NEWLINE ||
-           parser->current_token->type == TOKEN_INDENT)
+    while (parser->current_token.type == TOKEN_DEDENT ||
+           parser->current_token.type == TOKEN_NEWLINE ||
+           parser->current_token.type == TOKEN_INDENT)
     {
 
         // 更新缩进状态
-        if (parser->current_token->type == TOKEN_INDENT)
+        if (parser->current_token.type == TOKEN_INDENT)
         {
             parser->current_indent++;
         }
-        else if (parser->current_token->type == TOKEN_DEDENT)
+        else if (parser->current_token.type == TOKEN_DEDENT)
         {
             parser->current_indent--;
         }
 
-        eat(parser, parser->current_token->type);
+        eat(parser, parser->current_token.type);
     }
 
     // 打印调试信息
-    printf("[PARSER] parse_statement token: %s (%d)\n",
-           token_type_to_string(parser->current_token->type),
-           parser->current_token->type);
+    TRACE(TRACE_PARSER, "parse_statement token: %s (%d)",
+          token_type_to_string(parser->current_token.type),
+          parser->current_token.type);
 
     // 识别不同语句类型
-    switch (parser->current_token->type)
+    switch (parser->current_token.type)
     {
     case TOKEN_SAY:
         return parse_say_statement(parser);
@@ -114,10 +164,9 @@ ASTNode *parse_statement(Parser *parser)
     }
 
     // 未知语句类型
-    fprintf(stderr, "Syntax error: Unknown statement. Got token %d (%s)\n",
-            parser->current_token->type,
-            token_type_to_string(parser->current_token->type));
-    exit(1);
+    parser_error(parser, "Syntax error: Unknown statement. Got token %d (%s)",
+                parser->current_token.type,
+                token_type_to_string(parser->current_token.type));
 }
 
 ASTNode *parse_say_statement(Parser *parser)
@@ -125,45 +174,52 @@ ASTNode *parse_say_statement(Parser *parser)
     eat(parser, TOKEN_SAY); // 消耗'say' token
 
     // 确保下一个token是字符串
-    if (parser->current_token->type != TOKEN_STRING)
+    if (parser->current_token.type != TOKEN_STRING)
     {
-        fprintf(stderr, "Syntax error: Expected string after 'say'\n");
-        exit(1);
+        parser_error(parser, "Syntax error: Expected string after 'say'");
     }
 
-    char *str_value = parser->current_token->value ? strdup(parser->current_token->value) : strdup("");
+    // 节点直接引用源码中的字符串，转义留到代码生成时再做
+    Token str = parser->current_token;
+    const char *text = stable_text(parser, str);
 
     eat(parser, TOKEN_STRING); // 消耗字符串token
 
-    return create_say_node(str_value);
+    return create_say_node(parser->lexer->arena, text, str.length);
 }
 
 ASTNode *parse_function_definition(Parser *parser)
 {
-    printf("[PARSER] Parsing function definition\n");
+    TRACE(TRACE_PARSER, "Parsing function definition");
 
     // 消耗 function 关键字
     eat(parser, TOKEN_FUNCTION);
 
     // 检查函数名
-    if (parser->current_token->type != TOKEN_IDENTIFIER)
+    if (parser->current_token.type != TOKEN_IDENTIFIER)
+    {
+        parser_error(parser, "Syntax error: Expected function name after 'function'. Got token %d (%s)",
+                    parser->current_token.type,
+                    token_type_to_string(parser->current_token.type));
+    }
+    Token name = parser->current_token;
+    Symbol *symbol = intern_name(parser, name);
+    if (symbol->line)
     {
-        fprintf(stderr, "Syntax error: Expected function name after 'function'. Got token %d (%s)\n",
-                parser->current_token->type,
-                token_type_to_string(parser->current_token->type));
-        exit(1);
+        parser_error(parser, "Error: function '%.*s' is already defined at line %d",
+                    (int)name.length, symbol->name, symbol->line);
     }
-    char *func_name = strdup(parser->current_token->value);
+    symbol->line = token_line(parser, name);
+    const char *func_name = symbol->name;
     eat(parser, TOKEN_IDENTIFIER);
-    printf("  Function name: '%s'\n", func_name);
+    TRACE(TRACE_PARSER, "Function name: '%.*s'", (int)name.length, func_name);
 
     // 检查冒号
-    if (parser->current_token->type != TOKEN_COLON)
+    if (parser->current_token.type != TOKEN_COLON)
     {
-        fprintf(stderr, "Syntax error: Expected colon after function name. Got token %d (%s)\n",
-                parser->current_token->type,
-                token_type_to_string(parser->current_token->type));
-        exit(1);
+        parser_error(parser, "Syntax error: Expected colon after function name. Got token %d (%s)",
+                    parser->current_token.type,
+                    token_type_to_string(parser->current_token.type));
     }
     eat(parser, TOKEN_COLON);
 
@@ -171,187 +227,187 @@ ASTNode *parse_function_definition(Parser *parser)
     int first_token = 1;
 
     // 解析函数体
-    ASTNode **body = malloc(MAX_STATEMENTS * sizeof(ASTNode *));
-    int body_count = 0;
+    NodeList body = {0};
     parser->current_indent = -1; // 标记函数体缩进级别未设置
 
     // 直到遇到end或DEDENT
     while (1)
     {
         // 处理空白token
-        while (parser->current_token->type == TOKEN_NEWLINE ||
-               parser->current_token->type == TOKEN_INDENT ||
-               parser->current_token->type == TOKEN_DEDENT)
+        while (parser->current_token.type == TOKEN_NEWLINE ||
+               parser->current_token.type == TOKEN_INDENT ||
+               parser->current_token.type == TOKEN_DEDENT)
         {
 
             // 第一次遇到缩进，设置当前缩进级别
-            if (parser->current_token->type == TOKEN_INDENT &&
+            if (parser->current_token.type == TOKEN_INDENT &&
                 parser->current_indent == -1)
             {
                 parser->current_indent = parser->lexer->indent_stack[parser->lexer->indent_top];
-                printf("  Function body indent set to: %d\n", parser->current_indent);
+                TRACE(TRACE_PARSER, "Function body indent set to: %d", parser->current_indent);
             }
 
-            eat(parser, parser->current_token->type);
+            eat(parser, parser->current_token.type);
         }
 
         // 检查结束条件
-        if (parser->current_token->type == TOKEN_END)
+        if (parser->current_token.type == TOKEN_END)
         {
             break;
         }
 
         // 如果遇到DEDENT，检查是否已经返回到函数定义层级
-        if (parser->current_token->type == TOKEN_DEDENT &&
+        if (parser->current_token.type == TOKEN_DEDENT &&
             parser->current_indent != -1 &&
             parser->lexer->indent_stack[parser->lexer->indent_top] < parser->current_indent)
         {
-            printf("  Exiting function body at indent: %d (current: %d)\n",
-                   parser->current_indent, parser->lexer->indent_stack[parser->lexer->indent_top]);
+            TRACE(TRACE_PARSER, "Exiting function body at indent: %d (current: %d)",
+                  parser->current_indent, parser->lexer->indent_stack[parser->lexer->indent_top]);
             break;
         }
 
         // 遇到函数体中的语句
-        printf("  Parsing function body statement (%s)\n", token_type_to_string(parser->current_token->type));
-        body[body_count] = parse_statement(parser);
-        if (body[body_count] != NULL)
+        TRACE(TRACE_PARSER, "Parsing function body statement (%s)", token_type_to_string(parser->current_token.type));
+        ASTNode *stmt = parse_statement(parser);
+        if (stmt != NULL)
         {
-            body_count++;
+            node_list_push(parser->lexer->arena, &body, stmt);
         }
     }
 
     // 消耗end关键字
-    if (parser->current_token->type == TOKEN_END)
+    if (parser->current_token.type == TOKEN_END)
     {
         eat(parser, TOKEN_END);
     }
     else
     {
-        fprintf(stderr, "Syntax error: Expected 'end' to close function definition. Got %d (%s)\n",
-                parser->current_token->type,
-                token_type_to_string(parser->current_token->type));
-        exit(1);
+        parser_error(parser, "Syntax error: Expected 'end' to close function definition. Got %d (%s)",
+                    parser->current_token.type,
+                    token_type_to_string(parser->current_token.type));
     }
 
     // 重置缩进级别
     parser->current_indent = 0;
-    printf("Successfully parsed function '%s' with %d statements\n", func_name, body_count);
+    TRACE(TRACE_PARSER, "Successfully parsed function '%.*s' with %d statements", (int)name.length, func_name, body.count);
 
-    return create_function_def_node(func_name, body, body_count);
+    return create_function_def_node(parser->lexer->arena, func_name, name.length, body.items, body.count);
 }
 
 ASTNode *parse_function_call(Parser *parser)
 {
-    if (parser->current_token->type != TOKEN_IDENTIFIER)
+    if (parser->current_token.type != TOKEN_IDENTIFIER)
     {
-        fprintf(stderr, "Syntax error: Expected function name\n");
-        exit(1);
+        parser_error(parser, "Syntax error: Expected function name");
     }
 
-    char *func_name = strdup(parser->current_token->value);
+    Token name = parser->current_token;
+    Symbol *symbol = intern_name(parser, name);
     eat(parser, TOKEN_IDENTIFIER);
 
-    return create_function_call_node(func_name);
+    return create_function_call_node(parser->lexer->arena, symbol->name, name.length);
 }
 
 ASTNode *parse_block(Parser *parser, int *count)
 {
-    *count = 0;
-    ASTNode **nodes = malloc(MAX_STATEMENTS * sizeof(ASTNode *));
+    NodeList nodes = {0};
 
     while (1)
     {
         // 处理行内Token
-        while (parser->current_token->type == TOKEN_NEWLINE ||
-               parser->current_token->type == TOKEN_INDENT)
+        while (parser->current_token.type == TOKEN_NEWLINE ||
+               parser->current_token.type == TOKEN_INDENT)
         { // 添加对缩进Token的处理
-            eat(parser, parser->current_token->type);
+            eat(parser, parser->current_token.type);
         }
 
         // 块结束检查
-        if (parser->current_token->type == TOKEN_DEDENT ||
-            parser->current_token->type == TOKEN_END)
+        if (parser->current_token.type == TOKEN_DEDENT ||
+            parser->current_token.type == TOKEN_END)
         {
             break;
         }
 
-        nodes[*count] = parse_statement(parser);
-        (*count)++;
+        node_list_push(parser->lexer->arena, &nodes, parse_statement(parser));
     }
-    return *nodes;
+    *count = nodes.count;
+    return nodes.count ? nodes.items[0] : NULL;
 }
 
-ASTNode **parse_program(Parser *parser, int *count)
+// 解析start:之前的顶层语句和函数定义，停在start:或EOF
+static void parse_top_level(Parser *parser, NodeList *nodes)
 {
-    *count = 0;
-    ASTNode **nodes = malloc(MAX_STATEMENTS * sizeof(ASTNode *));
-
     // 允许函数定义出现在程序开头
-    while (parser->current_token->type != TOKEN_EOF)
+    while (parser->current_token.type != TOKEN_EOF)
     {
         // 跳过缩进和换行符
-        while (parser->current_token->type == TOKEN_NEWLINE ||
-               parser->current_token->type == TOKEN_INDENT ||
-               parser->current_token->type == TOKEN_DEDENT)
+        while (parser->current_token.type == TOKEN_NEWLINE ||
+               parser->current_token.type == TOKEN_INDENT ||
+               parser->current_token.type == TOKEN_DEDENT)
         {
-            eat(parser, parser->current_token->type);
+            eat(parser, parser->current_token.type);
         }
 
         // 检查是否达到文件末尾
-        if (parser->current_token->type == TOKEN_EOF)
+        if (parser->current_token.type == TOKEN_EOF)
         {
             break;
         }
 
         // 检查是否遇到start关键字
-        if (parser->current_token->type == TOKEN_START)
+        if (parser->current_token.type == TOKEN_START)
         {
             break;
         }
 
-        // 解析函数定义
-        if (*count >= MAX_STATEMENTS)
-        {
-            fprintf(stderr, "Error: Too many statements\n");
-            exit(1);
-        }
-
         // 解析其他语句（包括函数定义）
         ASTNode *node = parse_statement(parser);
         if (node)
         {
-            nodes[(*count)++] = node;
+            node_list_push(parser->lexer->arena, nodes, node);
         }
     }
+}
+
+ASTNode **parse_program(Parser *parser, int *count)
+{
+    // 所有内存都在arena中，出错时直接丢弃已解析的部分
+    if (setjmp(parser->error_jump) != 0)
+    {
+        *count = 0;
+        return NULL;
+    }
+
+    NodeList nodes = {0};
+
+    parse_top_level(parser, &nodes);
 
     // 程序必须以start开始
-    if (parser->current_token->type != TOKEN_START)
+    if (parser->current_token.type != TOKEN_START)
     {
-        fprintf(stderr, "Syntax error: Program must contain 'start:' block\n");
-        exit(1);
+        parser_error(parser, "Syntax error: Program must contain 'start:' block");
     }
     eat(parser, TOKEN_START); // 消耗start token
 
     // 处理可选的换行符
-    while (parser->current_token->type == TOKEN_NEWLINE)
+    while (parser->current_token.type == TOKEN_NEWLINE)
     {
         eat(parser, TOKEN_NEWLINE);
     }
 
     // 必须有缩进
-    if (parser->current_token->type != TOKEN_INDENT)
+    if (parser->current_token.type != TOKEN_INDENT)
     {
-        fprintf(stderr, "Syntax error: Expected indentation after 'start:'\n");
-        exit(1);
+        parser_error(parser, "Syntax error: Expected indentation after 'start:'");
     }
     eat(parser, TOKEN_INDENT);
     parser->current_indent++;
 
     // 解析程序主体
-    while (parser->current_token->type != TOKEN_EOF)
+    while (parser->current_token.type != TOKEN_EOF)
     {
         // 处理缩出（从当前缩进级别退出）
-        if (parser->current_token->type == TOKEN_DEDENT)
+        if (parser->current_token.type == TOKEN_DEDENT)
         {
             eat(parser, TOKEN_DEDENT);
             parser->current_indent--;
@@ -365,49 +421,40 @@ ASTNode **parse_program(Parser *parser, int *count)
         }
 
         // 跳过换行符
-        if (parser->current_token->type == TOKEN_NEWLINE)
+        if (parser->current_token.type == TOKEN_NEWLINE)
         {
             eat(parser, TOKEN_NEWLINE);
             continue;
         }
 
         // 处理end关键字（提前退出）
-        if (parser->current_token->type == TOKEN_END)
+        if (parser->current_token.type == TOKEN_END)
         {
             break;
         }
 
-        // 确保不超过最大语句数
-        if (*count >= MAX_STATEMENTS)
-        {
-            fprintf(stderr, "Too many statements\n");
-            exit(1);
-        }
-
         // 解析语句
-        nodes[(*count)++] = parse_statement(parser);
+        node_list_push(parser->lexer->arena, &nodes, parse_statement(parser));
     }
 
     // 在缩出循环后，跳过所有换行符和DEDENT
-    while (parser->current_token->type == TOKEN_NEWLINE ||
-           parser->current_token->type == TOKEN_DEDENT)
+    while (parser->current_token.type == TOKEN_NEWLINE ||
+           parser->current_token.type == TOKEN_DEDENT)
     {
-        eat(parser, parser->current_token->type);
+        eat(parser, parser->current_token.type);
     }
 
     // 处理end关键字
-    if (parser->current_token->type == TOKEN_EOF)
+    if (parser->current_token.type == TOKEN_EOF)
     {
-        fprintf(stderr, "Syntax error: Program must end with 'end'\n");
-        exit(1);
+        parser_error(parser, "Syntax error: Program must end with 'end'");
     }
 
-    if (parser->current_token->type != TOKEN_END)
+    if (parser->current_token.type != TOKEN_END)
     {
-        fprintf(stderr, "Syntax error: Expected 'end' at end of program. Got token type %d (%s)\n",
-                parser->current_token->type,
-                token_type_to_string(parser->current_token->type));
-        exit(1);
+        parser_error(parser, "Syntax error: Expected 'end' at end of program. Got token type %d (%s)",
+                    parser->current_token.type,
+                    token_type_to_string(parser->current_token.type));
     }
     eat(parser, TOKEN_END);
 
@@ -415,7 +462,7 @@ ASTNode **parse_program(Parser *parser, int *count)
     if (parser->current_indent != 0)
     {
         // 处理剩余的缩出标记
-        while (parser->current_token->type == TOKEN_DEDENT)
+        while (parser->current_token.type == TOKEN_DEDENT)
         {
             eat(parser, TOKEN_DEDENT);
             parser->current_indent--;
@@ -424,11 +471,35 @@ ASTNode **parse_program(Parser *parser, int *count)
         // 如果还有剩余的缩进级别
         if (parser->current_indent != 0)
         {
-            fprintf(stderr, "Syntax error: Missing dedent at end of program (indent level=%d)\n",
-                    parser->current_indent);
-            exit(1);
+            parser_error(parser, "Syntax error: Missing dedent at end of program (indent level=%d)",
+                        parser->current_indent);
         }
     }
 
-    return nodes;
+    // 空程序也要返回非NULL，NULL表示出错
+    if (!nodes.items)
+        nodes.items = arena_alloc(parser->lexer->arena, sizeof(ASTNode *));
+    *count = nodes.count;
+    return nodes.items;
+}
+
+ASTNode **parse_definitions(Parser *parser, int *count)
+{
+    if (setjmp(parser->error_jump) != 0)
+    {
+        *count = 0;
+        return NULL;
+    }
+
+    NodeList nodes = {0};
+    parse_top_level(parser, &nodes);
+    if (parser->current_token.type != TOKEN_EOF)
+    {
+        parser_error(parser, "Syntax error: Unexpected 'start:' among function definitions");
+    }
+
+    if (!nodes.items)
+        nodes.items = arena_alloc(parser->lexer->arena, sizeof(ASTNode *));
+    *count = nodes.count;
+    return nodes.items;
 }
\ No newline at end of file
@@ -0,0 +1,174 @@
+#include "prelude.h"
+#include "sha256.h"
+#include "toolchain.h"
+#include "trace.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// 每个头文件附带一组会用到它的标识符，供PRELUDE_MINIMAL判断是否需要
+typedef struct
+{
+    const char *header;
+    const char *const *symbols;
+} PreludeHeader;
+
+static const char *const stdio_symbols[] = {NULL}; // say总是需要stdio.h
+static const char *const stdlib_symbols[] = {
+    "malloc", "calloc", "realloc", "free", "exit", "abort", "atexit", "atoi", "atol", "atof",
+    "strtol", "strtoul", "strtod", "rand", "srand", "RAND_MAX", "abs", "labs", "div", "qsort",
+    "bsearch", "getenv", "system", "EXIT_SUCCESS", "EXIT_FAILURE", NULL};
+static const char *const string_symbols[] = {
+    "strlen", "strcpy", "strncpy", "strcat", "strncat", "strcmp", "strncmp", "strchr", "strrchr",
+    "strstr", "strtok", "strdup", "strerror", "memcpy", "memmove", "memset", "memcmp", "memchr", NULL};
+static const char *const math_symbols[] = {
+    "sqrt", "pow", "sin", "cos", "tan", "asin", "acos", "atan", "atan2", "exp", "log", "log10",
+    "fabs", "floor", "ceil", "round", "fmod", "hypot", "M_PI", "M_E", "INFINITY", "NAN", NULL};
+static const char *const time_symbols[] = {
+    "time_t", "clock_t", "tm", "time", "clock", "difftime", "mktime", "gmtime", "localtime",
+    "asctime", "ctime", "strftime", "CLOCKS_PER_SEC", NULL};
+static const char *const ctype_symbols[] = {
+    "isalpha", "isdigit", "isalnum", "isspace", "isupper", "islower", "ispunct", "isprint",
+    "isxdigit", "iscntrl", "toupper", "tolower", NULL};
+static const char *const float_symbols[] = {
+    "FLT_MAX", "FLT_MIN", "FLT_EPSILON", "FLT_DIG", "DBL_MAX", "DBL_MIN", "DBL_EPSILON", "DBL_DIG", NULL};
+static const char *const assert_symbols[] = {"assert", NULL};
+static const char *const errno_symbols[] = {"errno", "EDOM", "ERANGE", "EINVAL", "ENOENT", NULL};
+static const char *const stddef_symbols[] = {"ptrdiff_t", "offsetof", "max_align_t", NULL};
+static const char *const signal_symbols[] = {
+    "signal", "raise", "sig_atomic_t", "SIGINT", "SIGTERM", "SIGABRT", "SIGSEGV", "SIGFPE",
+    "SIG_IGN", "SIG_DFL", NULL};
+static const char *const setjmp_symbols[] = {"jmp_buf", "setjmp", "longjmp", NULL};
+static const char *const locale_symbols[] = {"setlocale", "localeconv", "LC_ALL", "LC_CTYPE", "LC_NUMERIC", NULL};
+
+static const PreludeHeader prelude_headers[] = {
+    {"stdio.h", stdio_symbols},
+    {"stdlib.h", stdlib_symbols},
+    {"string.h", string_symbols},
+    {"math.h", math_symbols},
+    {"time.h", time_symbols},
+    {"ctype.h", ctype_symbols},
+    {"float.h", float_symbols},
+    {"assert.h", assert_symbols},
+    {"errno.h", errno_symbols},
+    {"stddef.h", stddef_symbols},
+    {"signal.h", signal_symbols},
+    {"setjmp.h", setjmp_symbols},
+    {"locale.h", locale_symbols},
+};
+
+#define PRELUDE_HEADER_COUNT (sizeof(prelude_headers) / sizeof(prelude_headers[0]))
+
+static int is_ident_start(char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+static int is_ident_char(char c)
+{
+    return is_ident_start(c) || (c >= '0' && c <= '9');
+}
+
+// C头中是否出现某个标识符（按完整标识符匹配）
+static int header_uses(const char *c_header, const char *symbol)
+{
+    size_t len = strlen(symbol);
+    for (const char *p = strstr(c_header, symbol); p; p = strstr(p + 1, symbol))
+    {
+        if ((p == c_header || !is_ident_char(p[-1])) && !is_ident_char(p[len]))
+            return 1;
+    }
+    return 0;
+}
+
+static int prelude_needs(const PreludeHeader *entry, const char *c_header)
+{
+    if (entry->symbols[0] == NULL)
+        return 1;
+    if (!c_header)
+        return 0;
+    for (int i = 0; entry->symbols[i]; i++)
+    {
+        if (header_uses(c_header, entry->symbols[i]))
+            return 1;
+    }
+    return 0;
+}
+
+void write_prelude(CodeBuffer *output, PreludeMode mode, const char *c_header)
+{
+    if (mode == PRELUDE_PCH)
+        return;
+    for (size_t i = 0; i < PRELUDE_HEADER_COUNT; i++)
+    {
+        if (mode == PRELUDE_FULL || prelude_needs(&prelude_headers[i], c_header))
+        {
+            codebuf_append_literal(output, "#include <");
+            codebuf_append(output, prelude_headers[i].header, strlen(prelude_headers[i].header));
+            codebuf_append_literal(output, ">\n");
+        }
+    }
+    codebuf_append_char(output, '\n');
+}
+
+int prelude_prepare_pch(BuildCache *cache, char *header_path, size_t size)
+{
+    char version[1024];
+    if (cc_version(version, sizeof(version)) != 0)
+        return -1;
+
+    // 目录名由gcc版本和prelude内容决定，升级gcc后自动重新生成
+    Sha256 ctx;
+    char hash[SHA256_HEX_SIZE];
+    sha256_init(&ctx);
+    sha256_update(&ctx, version, strlen(version));
+    for (size_t i = 0; i < PRELUDE_HEADER_COUNT; i++)
+        sha256_update(&ctx, prelude_headers[i].header, strlen(prelude_headers[i].header) + 1);
+    sha256_final_hex(&ctx, hash);
+
+    char dir[PATH_MAX + 100];
+    snprintf(dir, sizeof(dir), "%s/prelude-%.16s", cache->dir, hash);
+    if ((size_t)snprintf(header_path, size, "%s/hercode_prelude.h", dir) >= size)
+        return -1;
+
+    char pch_path[PATH_MAX + 140];
+    snprintf(pch_path, sizeof(pch_path), "%s.gch", header_path);
+    if (access(pch_path, R_OK) == 0)
+        return 0;
+
+    if (mkdir(dir, 0755) != 0 && errno != EEXIST)
+        return -1;
+
+    // 头文件和.gch都先写临时文件再rename，多个编译同时生成也不会互相破坏
+    char temp[PATH_MAX + 160];
+    snprintf(temp, sizeof(temp), "%s.XXXXXX", header_path);
+    int fd = mkstemp(temp);
+    if (fd < 0)
+        return -1;
+    CodeBuffer header;
+    codebuf_init(&header, 512);
+    write_prelude(&header, PRELUDE_FULL, NULL);
+    int written = codebuf_write(&header, fd);
+    codebuf_free(&header);
+    if (close(fd) != 0 || written != 0 || chmod(temp, 0644) != 0 || rename(temp, header_path) != 0)
+    {
+        unlink(temp);
+        return -1;
+    }
+
+    snprintf(temp, sizeof(temp), "%s.gch.XXXXXX", header_path);
+    fd = mkstemp(temp);
+    if (fd < 0)
+        return -1;
+    close(fd);
+    char *argv[] = {CC_PROGRAM, "-x", "c-header", header_path, "-o", temp, NULL};
+    if (run_command(argv, NULL) != 0 || rename(temp, pch_path) != 0)
+    {
+        unlink(temp);
+        return -1;
+    }
+    TRACE(TRACE_CODEGEN, "Built precompiled prelude %s", pch_path);
+    return 0;
+}
@@ -0,0 +1,172 @@
+#include "scan.h"
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__x86_64__) && defined(__GNUC__)
+#define SCAN_X86 1
+#include <immintrin.h>
+#endif
+
+static const char *find_scalar(const char *p, char a)
+{
+    while (*p != a && *p != '\0')
+        p++;
+    return p;
+}
+
+static const char *skip_blanks_scalar(const char *p)
+{
+    while (*p == ' ' || *p == '\t')
+        p++;
+    return p;
+}
+
+#ifdef SCAN_X86
+// SSE2是x86-64的基本指令集，不需要检测。
+// 从p向下对齐到16字节开始读，第一块里p之前的位从掩码中移掉
+static const char *find_sse2(const char *p, char a)
+{
+    const __m128i va = _mm_set1_epi8(a);
+    const __m128i zero = _mm_setzero_si128();
+    size_t skip = (uintptr_t)p & 15;
+    const char *block = p - skip;
+    __m128i x = _mm_load_si128((const __m128i *)block);
+    unsigned mask = (unsigned)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(x, va), _mm_cmpeq_epi8(x, zero)));
+    mask >>= skip;
+    if (mask)
+        return p + __builtin_ctz(mask);
+    for (;;)
+    {
+        block += 16;
+        x = _mm_load_si128((const __m128i *)block);
+        mask = (unsigned)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(x, va), _mm_cmpeq_epi8(x, zero)));
+        if (mask)
+            return block + __builtin_ctz(mask);
+    }
+}
+
+static const char *skip_blanks_sse2(const char *p)
+{
+    const __m128i space = _mm_set1_epi8(' ');
+    const __m128i tab = _mm_set1_epi8('\t');
+    size_t skip = (uintptr_t)p & 15;
+    const char *block = p - skip;
+    __m128i x = _mm_load_si128((const __m128i *)block);
+    unsigned mask = ~(unsigned)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(x, space), _mm_cmpeq_epi8(x, tab)));
+    mask = (mask & 0xffff) >> skip;
+    if (mask)
+        return p + __builtin_ctz(mask);
+    for (;;)
+    {
+        block += 16;
+        x = _mm_load_si128((const __m128i *)block);
+        mask = ~(unsigned)_mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(x, space), _mm_cmpeq_epi8(x, tab)));
+        mask &= 0xffff;
+        if (mask)
+            return block + __builtin_ctz(mask);
+    }
+}
+
+__attribute__((target("avx2"))) static const char *find_avx2(const char *p, char a)
+{
+    const __m256i va = _mm256_set1_epi8(a);
+    const __m256i zero = _mm256_setzero_si256();
+    size_t skip = (uintptr_t)p & 31;
+    const char *block = p - skip;
+    __m256i x = _mm256_load_si256((const __m256i *)block);
+    uint32_t mask = (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(x, va), _mm256_cmpeq_epi8(x, zero)));
+    mask >>= skip;
+    if (mask)
+        return p + __builtin_ctz(mask);
+    for (;;)
+    {
+        block += 32;
+        x = _mm256_load_si256((const __m256i *)block);
+        mask = (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(x, va), _mm256_cmpeq_epi8(x, zero)));
+        if (mask)
+            return block + __builtin_ctz(mask);
+    }
+}
+
+__attribute__((target("avx2"))) static const char *skip_blanks_avx2(const char *p)
+{
+    const __m256i space = _mm256_set1_epi8(' ');
+    const __m256i tab = _mm256_set1_epi8('\t');
+    size_t skip = (uintptr_t)p & 31;
+    const char *block = p - skip;
+    __m256i x = _mm256_load_si256((const __m256i *)block);
+    uint32_t mask = ~(uint32_t)_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(x, space), _mm256_cmpeq_epi8(x, tab)));
+    mask >>= skip;
+    if (mask)
+        return p + __builtin_ctz(mask);
+    for (;;)
+    {
+        block += 32;
+        x = _mm256_load_si256((const __m256i *)block);
+        mask = ~(uint32_t)_mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(x, space), _mm256_cmpeq_epi8(x, tab)));
+        if (mask)
+            return block + __builtin_ctz(mask);
+    }
+}
+#endif
+
+typedef struct
+{
+    const char *name;
+    const char *(*find)(const char *p, char a);
+    const char *(*skip_blanks)(const char *p);
+} Scanner;
+
+static const Scanner scanners[] = {
+#ifdef SCAN_X86
+    {"avx2", find_avx2, skip_blanks_avx2},
+    {"sse2", find_sse2, skip_blanks_sse2},
+#endif
+    {"scalar", find_scalar, skip_blanks_scalar},
+};
+
+static const Scanner *scanner;
+static pthread_once_t scanner_once = PTHREAD_ONCE_INIT;
+
+// $HERCODE_SCAN可以强制选择实现，用于比较性能；不支持的选择被忽略
+static void select_scanner(void)
+{
+    const char *forced = getenv("HERCODE_SCAN");
+    size_t count = sizeof(scanners) / sizeof(scanners[0]);
+    for (size_t i = 0; i < count; i++)
+    {
+#ifdef SCAN_X86
+        if (scanners[i].find == find_avx2 && !__builtin_cpu_supports("avx2"))
+            continue;
+#endif
+        if (!forced || strcmp(forced, scanners[i].name) == 0)
+        {
+            scanner = &scanners[i];
+            return;
+        }
+    }
+    scanner = &scanners[count - 1];
+}
+
+static const Scanner *get_scanner(void)
+{
+    pthread_once(&scanner_once, select_scanner);
+    return scanner;
+}
+
+const char *scan_find(const char *p, char a)
+{
+    return get_scanner()->find(p, a);
+}
+
+const char *scan_skip_blanks(const char *p)
+{
+    return get_scanner()->skip_blanks(p);
+}
+
+const char *scan_implementation(void)
+{
+    return get_scanner()->name;
+}
@@ -0,0 +1,346 @@
+#define _GNU_SOURCE // accept4
+#include "server.h"
+#include "threadpool.h"
+#include <errno.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_REQUEST_SIZE (2 * PATH_MAX + 256)
+// 读请求和写响应的时限：空闲或者很慢的客户端不能一直占着工作线程
+#define IO_TIMEOUT_SECONDS 10
+
+typedef struct Connection
+{
+    int fd;
+    const CompileOptions *options; // 服务器的公共选项，包括AST缓存
+} Connection;
+
+static volatile sig_atomic_t stop_requested = 0;
+
+static void handle_stop(int sig)
+{
+    (void)sig;
+    stop_requested = 1;
+}
+
+static double elapsed_ms(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (now.tv_sec - start->tv_sec) * 1e3 + (now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+static int write_all(int fd, const char *data, size_t size)
+{
+    while (size > 0)
+    {
+        ssize_t n = write(fd, data, size);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return -1;
+        data += n;
+        size -= n;
+    }
+    return 0;
+}
+
+static int make_address(const char *socket_path, struct sockaddr_un *address)
+{
+    memset(address, 0, sizeof(*address));
+    address->sun_family = AF_UNIX;
+    if (strlen(socket_path) >= sizeof(address->sun_path))
+    {
+        fprintf(stderr, "Error: socket path is too long: %s\n", socket_path);
+        return -1;
+    }
+    strcpy(address->sun_path, socket_path);
+    return 0;
+}
+
+// 每次read和write最多阻塞IO_TIMEOUT_SECONDS秒
+static void set_io_timeout(int fd)
+{
+    struct timeval timeout = {IO_TIMEOUT_SECONDS, 0};
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+}
+
+// 读取请求直到空行，返回以'\0'结尾的请求文本（调用者释放）。
+// 单次read超时或者从start算起总共超过时限都放弃，逐字节慢慢发送也占不住线程
+static char *read_request(int fd, const struct timespec *start)
+{
+    char *buffer = malloc(MAX_REQUEST_SIZE + 1);
+    size_t size = 0;
+    while (buffer && size < MAX_REQUEST_SIZE && elapsed_ms(start) < IO_TIMEOUT_SECONDS * 1e3)
+    {
+        ssize_t n = read(fd, buffer + size, MAX_REQUEST_SIZE - size);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        size += n;
+        buffer[size] = '\0';
+        if (strstr(buffer, "\n\n"))
+            return buffer;
+    }
+    free(buffer);
+    return NULL;
+}
+
+// 按请求覆盖服务器的选项；不认识的键或值返回错误信息
+static const char *parse_request(char *request, CompileOptions *options,
+                                 const char **source, const char **output)
+{
+    char *save = NULL;
+    for (char *line = strtok_r(request, "\n", &save); line; line = strtok_r(NULL, "\n", &save))
+    {
+        char *value = strchr(line, ' ');
+        if (!value)
+            return "malformed request line";
+        *value++ = '\0';
+        if (strcmp(line, "source") == 0)
+            *source = value;
+        else if (strcmp(line, "output") == 0)
+            *output = value;
+        else if (strcmp(line, "opt") == 0 && value[0] >= '0' && value[0] <= '2' && value[1] == '\0')
+            options->opt_level = (OptLevel)(value[0] - '0');
+        else if (strcmp(line, "backend") == 0 && strcmp(value, "c") == 0)
+            options->backend = BACKEND_C;
+        else if (strcmp(line, "backend") == 0 && strcmp(value, "native") == 0)
+            options->backend = BACKEND_NATIVE;
+        else if (strcmp(line, "stats") == 0)
+            options->show_stats = atoi(value);
+        else
+            return "unknown request field";
+    }
+    if (!*source || !*output)
+        return "request needs a source and an output path";
+    if ((*source)[0] != '/' || (*output)[0] != '/')
+        return "paths in a request must be absolute";
+    return NULL;
+}
+
+static void serve_connection(void *arg)
+{
+    Connection *connection = arg;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    CompileOptions options = *connection->options;
+    const char *source = NULL;
+    const char *output = NULL;
+    char *request = read_request(connection->fd, &start);
+    const char *error = request ? parse_request(request, &options, &source, &output) : "incomplete request";
+
+    // 诊断信息先收集到内存，和状态一起发回客户端
+    char *text = NULL;
+    size_t size = 0;
+    FILE *diag = open_memstream(&text, &size);
+    int status = 1;
+    if (!diag)
+        error = "out of memory";
+    else if (error)
+        fprintf(diag, "Error: %s\n", error);
+    else
+        status = compile_file(source, output, &options, diag);
+    if (diag)
+        fclose(diag);
+
+    char header[32];
+    int header_size = snprintf(header, sizeof(header), "status %d\n", status);
+    if (write_all(connection->fd, header, header_size) == 0 && size > 0)
+        write_all(connection->fd, text, size);
+    close(connection->fd);
+
+    fprintf(stderr, "[server] %s: %s in %.1f ms\n", source ? source : "(bad request)",
+            status == 0 ? "ok" : "failed", elapsed_ms(&start));
+    free(text);
+    free(request);
+    free(connection);
+}
+
+// 套接字文件已经存在时，确认没有别的服务器在用它再删除
+static int claim_socket_path(const char *socket_path, const struct sockaddr_un *address)
+{
+    struct stat info;
+    if (lstat(socket_path, &info) != 0)
+        return 0;
+    if (!S_ISSOCK(info.st_mode))
+    {
+        fprintf(stderr, "Error: %s exists and is not a socket\n", socket_path);
+        return -1;
+    }
+    int probe = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (probe >= 0 && connect(probe, (const struct sockaddr *)address, sizeof(*address)) == 0)
+    {
+        close(probe);
+        fprintf(stderr, "Error: a server is already listening on %s\n", socket_path);
+        return -1;
+    }
+    if (probe >= 0)
+        close(probe);
+    unlink(socket_path);
+    return 0;
+}
+
+int run_server(const char *socket_path, int jobs, const CompileOptions *options)
+{
+    struct sockaddr_un address;
+    if (make_address(socket_path, &address) != 0 || claim_socket_path(socket_path, &address) != 0)
+        return 1;
+
+    int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (listener < 0 || bind(listener, (struct sockaddr *)&address, sizeof(address)) != 0 ||
+        listen(listener, 64) != 0)
+    {
+        fprintf(stderr, "Error: cannot listen on %s: %s\n", socket_path, strerror(errno));
+        if (listener >= 0)
+            close(listener);
+        return 1;
+    }
+
+    // 不设置SA_RESTART，让accept在收到信号时返回
+    struct sigaction action;
+    memset(&action, 0, sizeof(action));
+    action.sa_handler = handle_stop;
+    sigemptyset(&action.sa_mask);
+    sigaction(SIGINT, &action, NULL);
+    sigaction(SIGTERM, &action, NULL);
+
+    AstCache ast_cache;
+    ast_cache_init(&ast_cache, AST_CACHE_DEFAULT_ENTRIES);
+    CompileOptions server_options = *options;
+    server_options.ast_cache = &ast_cache;
+
+    ThreadPool *pool = threadpool_create(jobs);
+    fprintf(stderr, "[server] listening on %s with %d workers\n", socket_path, pool->thread_count);
+    while (!stop_requested)
+    {
+        int fd = accept4(listener, NULL, NULL, SOCK_CLOEXEC);
+        if (fd < 0)
+        {
+            if (errno == EINTR || errno == ECONNABORTED)
+                continue;
+            fprintf(stderr, "Error: accept failed: %s\n", strerror(errno));
+            break;
+        }
+        Connection *connection = malloc(sizeof(Connection));
+        if (!connection)
+        {
+            close(fd);
+            continue;
+        }
+        set_io_timeout(fd);
+        connection->fd = fd;
+        connection->options = &server_options;
+        threadpool_submit(pool, serve_connection, connection);
+    }
+
+    close(listener);
+    unlink(socket_path);
+    threadpool_wait(pool);
+    threadpool_destroy(pool);
+    fprintf(stderr, "[server] stopped; AST cache: %lu hits, %lu misses\n", ast_cache.hits, ast_cache.misses);
+    ast_cache_destroy(&ast_cache);
+    return 0;
+}
+
+// 客户端和服务器的工作目录可能不同，请求里只发绝对路径
+static char *absolute_path(const char *path)
+{
+    if (path[0] == '/')
+        return strdup(path);
+    char cwd[PATH_MAX];
+    if (!getcwd(cwd, sizeof(cwd)))
+        return NULL;
+    char *result = malloc(strlen(cwd) + strlen(path) + 2);
+    if (result)
+        sprintf(result, "%s/%s", cwd, path);
+    return result;
+}
+
+int run_client(const char *socket_path, const char *source_path, const char *output_name,
+               const CompileOptions *options)
+{
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+
+    struct sockaddr_un address;
+    if (make_address(socket_path, &address) != 0)
+        return 1;
+    char *source = absolute_path(source_path);
+    char *output = absolute_path(output_name);
+    char request[MAX_REQUEST_SIZE];
+    int request_size = source && output
+                           ? snprintf(request, sizeof(request), "source %s\noutput %s\nopt %d\nbackend %s\nstats %d\n\n",
+                                      source, output, (int)options->opt_level,
+                                      options->backend == BACKEND_NATIVE ? "native" : "c", options->show_stats)
+                           : -1;
+    free(source);
+    free(output);
+    if (request_size < 0 || request_size >= (int)sizeof(request) || strchr(source_path, '\n') ||
+        strchr(output_name, '\n'))
+    {
+        fprintf(stderr, "Error: cannot build a request for %s\n", source_path);
+        return 1;
+    }
+
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&address, sizeof(address)) != 0)
+    {
+        fprintf(stderr, "Error: cannot connect to compile server at %s: %s\n", socket_path, strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        return 1;
+    }
+    if (write_all(fd, request, request_size) != 0)
+    {
+        fprintf(stderr, "Error: cannot send request to %s: %s\n", socket_path, strerror(errno));
+        close(fd);
+        return 1;
+    }
+
+    // 读取完整响应：状态行和诊断信息
+    char *response = NULL;
+    size_t size = 0, capacity = 0;
+    for (;;)
+    {
+        if (size == capacity)
+        {
+            capacity = capacity ? capacity * 2 : 4096;
+            char *grown = realloc(response, capacity + 1);
+            if (!grown)
+                break;
+            response = grown;
+        }
+        ssize_t n = read(fd, response + size, capacity - size);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        size += n;
+    }
+    close(fd);
+
+    int status = 1;
+    char *body = response ? memchr(response, '\n', size) : NULL;
+    if (!body || sscanf(response, "status %d", &status) != 1)
+    {
+        fprintf(stderr, "Error: malformed response from compile server at %s\n", socket_path);
+        free(response);
+        return 1;
+    }
+    body++;
+    fwrite(body, 1, size - (body - response), stderr);
+    fprintf(stderr, "client latency: %.1f ms\n", elapsed_ms(&start));
+    free(response);
+    return status != 0;
+}
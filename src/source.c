@@ -0,0 +1,136 @@
+#include "source.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// read的初始缓冲区大小，满了翻倍
+#define SOURCE_READ_SIZE (1 << 16)
+
+int source_read_fd(int fd, size_t limit, SourceFile *file)
+{
+    size_t capacity = limit ? limit : SOURCE_READ_SIZE;
+    size_t length = 0;
+    char *data = malloc(capacity + 1);
+    if (!data)
+        return -1;
+    for (;;)
+    {
+        if (length == capacity)
+        {
+            if (limit)
+                break;
+            char *grown = realloc(data, 2 * capacity + 1);
+            if (!grown)
+            {
+                free(data);
+                errno = ENOMEM;
+                return -1;
+            }
+            data = grown;
+            capacity *= 2;
+        }
+        ssize_t n = read(fd, data + length, capacity - length);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0)
+        {
+            int saved = errno;
+            free(data);
+            errno = saved;
+            return -1;
+        }
+        if (n == 0)
+            break;
+        length += (size_t)n;
+    }
+    data[length] = '\0';
+    file->data = data;
+    file->length = length;
+    file->mapped_length = 0;
+    return 0;
+}
+
+int source_read(const char *path, SourceFile *file)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    int status = source_read_fd(fd, 0, file);
+    int saved = errno;
+    close(fd);
+    errno = saved;
+    return status;
+}
+
+// 映射整个文件，后面至少跟一个字节的零：先占一段匿名内存，再把文件映射到开头。
+// 文件长度不是页大小的整数倍时，最后一页文件末尾之后本来就是零
+static char *map_file(int fd, size_t length, size_t *mapped_length)
+{
+    size_t page = (size_t)sysconf(_SC_PAGESIZE);
+    *mapped_length = (length / page + 1) * page;
+    // 私有映射：C头就地以'\0'结尾时只复制那一页，不会写回文件
+    char *data = mmap(NULL, *mapped_length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (data == MAP_FAILED)
+        return NULL;
+    if (mmap(data, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED)
+    {
+        munmap(data, *mapped_length);
+        return NULL;
+    }
+    // 词法分析从头到尾只读一遍
+    madvise(data, length, MADV_SEQUENTIAL);
+    return data;
+}
+
+int source_load(const char *path, SourceFile *file)
+{
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    struct stat st;
+    if (fstat(fd, &st) != 0)
+    {
+        int saved = errno;
+        close(fd);
+        errno = saved;
+        return -1;
+    }
+
+    // 管道、字符设备和/proc下报告长度为0的文件只能read；映射失败时也退回到read
+    char *data = NULL;
+    size_t mapped_length = 0;
+    if (S_ISREG(st.st_mode) && st.st_size > 0)
+        data = map_file(fd, (size_t)st.st_size, &mapped_length);
+    int status = 0;
+    if (data)
+    {
+        file->data = data;
+        file->length = (size_t)st.st_size;
+        file->mapped_length = mapped_length;
+    }
+    else
+        status = source_read_fd(fd, 0, file);
+    int saved = errno;
+    close(fd);
+    errno = saved;
+    return status;
+}
+
+void source_unload(SourceFile *file)
+{
+    if (file->mapped_length)
+        munmap(file->data, file->mapped_length);
+    else
+        free(file->data);
+    file->data = NULL;
+    file->length = 0;
+    file->mapped_length = 0;
+}
+
+const char *source_method(const SourceFile *file)
+{
+    return file->mapped_length ? "mmap" : "read";
+}
@@ -0,0 +1,224 @@
+#include "split.h"
+#include "codegen.h"
+#include "sha256.h"
+#include "threadpool.h"
+#include "toolchain.h"
+#include "trace.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define SPLIT_HEADER_NAME "hercode_functions.h"
+
+typedef struct
+{
+    CodeBuffer code;
+    char source_path[PATH_MAX];
+    char object_path[PATH_MAX];
+    char key[SHA256_HEX_SIZE];
+    int cached; // 目标文件来自缓存，不需要编译
+    int status;
+    const CompileOptions *options;
+    FILE *diag;
+} SplitUnit;
+
+static int write_unit_file(const char *path, const CodeBuffer *code)
+{
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0)
+        return -1;
+    int written = codebuf_write(code, fd);
+    return close(fd) == 0 && written == 0 ? 0 : -1;
+}
+
+// 单元内容、编译参数和gcc版本决定目标文件。头文件里只有void function_<name>();，
+// 单元用到哪些原型已经由它的内容决定，所以不把整个头文件算进去，
+// 增删别的函数不会让这个单元失效
+static int object_key(const SplitUnit *unit, const char *flags, char key[SHA256_HEX_SIZE])
+{
+    char version[1024];
+    if (cc_version(version, sizeof(version)) != 0)
+        return -1;
+    Sha256 ctx;
+    sha256_init(&ctx);
+    sha256_update(&ctx, "hercode-object-1", 17);
+    sha256_update(&ctx, version, strlen(version) + 1);
+    sha256_update(&ctx, flags, strlen(flags) + 1);
+    sha256_update(&ctx, unit->code.data, unit->code.length);
+    sha256_final_hex(&ctx, key);
+    return 0;
+}
+
+static void compile_unit(void *arg)
+{
+    SplitUnit *unit = arg;
+    const CompileOptions *options = unit->options;
+    char *argv[10];
+    int argc = 0;
+    argv[argc++] = CC_PROGRAM;
+    argv[argc++] = "-c";
+    argv[argc++] = "-x";
+    argv[argc++] = "c";
+    if (options->prelude == PRELUDE_PCH)
+    {
+        argv[argc++] = "-include";
+        argv[argc++] = (char *)options->prelude_path;
+    }
+    argv[argc++] = unit->source_path;
+    argv[argc++] = "-o";
+    argv[argc++] = unit->object_path;
+    argv[argc] = NULL;
+    unit->status = run_command(argv, unit->diag);
+    if (unit->status == 0 && unit->key[0])
+        cache_store(options->cache, unit->key, unit->object_path);
+}
+
+static void remove_work_dir(const char *dir, SplitUnit *units, int unit_count, const char *header_path)
+{
+    for (int i = 0; i < unit_count; i++)
+    {
+        unlink(units[i].source_path);
+        unlink(units[i].object_path);
+    }
+    unlink(header_path);
+    rmdir(dir);
+}
+
+// 在$TMPDIR（没有设置时是/tmp）下创建工作目录；目录名要给单元文件名留出空间
+static int make_work_dir(char *dir, size_t size)
+{
+    const char *tmp = getenv("TMPDIR");
+    if (!tmp || !*tmp)
+        tmp = "/tmp";
+    int length = snprintf(dir, size, "%s/hercode-split-XXXXXX", tmp);
+    if (length < 0 || (size_t)length + sizeof(SPLIT_HEADER_NAME) + 1 >= size)
+    {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    return mkdtemp(dir) ? 0 : -1;
+}
+
+int split_compile(const char *c_header, ASTNode **nodes, int count, const char *output_name,
+                  const CompileOptions *options, FILE *diag)
+{
+    TimeReport *report = options->time_report;
+    PhaseTimer timer;
+    int k = options->split_units;
+    int unit_count = k + 1; // 最后一个是main
+    char dir[PATH_MAX];
+    if (make_work_dir(dir, sizeof(dir)) != 0)
+    {
+        fprintf(diag, "Error: cannot create a directory for translation units: %s\n", strerror(errno));
+        return -1;
+    }
+
+    // 生成共用的原型头文件和各个单元
+    phase_begin(report, &timer);
+    Arena arena;
+    arena_init(&arena);
+    FunctionTable table;
+    build_function_table(&table, nodes, count, &arena);
+    SplitUnit *units = arena_alloc(&arena, unit_count * sizeof(SplitUnit));
+    memset(units, 0, unit_count * sizeof(SplitUnit));
+    for (int i = 0; i < unit_count; i++)
+    {
+        units[i].options = options;
+        units[i].diag = diag;
+        codebuf_init(&units[i].code, 1 << 12);
+        write_prelude(&units[i].code, options->prelude, c_header);
+        codebuf_append_literal(&units[i].code, "#include \"" SPLIT_HEADER_NAME "\"\n");
+        if (i < k)
+            codebuf_append_literal(&units[i].code, "\n/* Function implementations */\n");
+        snprintf(units[i].source_path, sizeof(units[i].source_path), "%s/unit%d.c", dir, i);
+        snprintf(units[i].object_path, sizeof(units[i].object_path), "%s/unit%d.o", dir, i);
+    }
+
+    CodeBuffer header;
+    codebuf_init(&header, 1 << 12);
+    codebuf_append_literal(&header, "#ifndef HERCODE_FUNCTIONS_H\n#define HERCODE_FUNCTIONS_H\n\n");
+    for (int i = 0; i < table.count; i++)
+    {
+        const FunctionDef *def = &table.defs[i];
+        write_function_declaration(&header, def);
+        // 按名字哈希分配，增删或修改一个函数只影响它所在的单元
+        Symbol *symbol = symtab_lookup(&table.symbols, def->name, def->name_length);
+        write_function_definition(&units[symbol->hash % k].code, def);
+    }
+    codebuf_append_literal(&header, "\n#endif\n");
+    write_main_function(&units[k].code, c_header, nodes, count);
+
+    char header_path[PATH_MAX];
+    snprintf(header_path, sizeof(header_path), "%s/" SPLIT_HEADER_NAME, dir);
+    int status = write_unit_file(header_path, &header);
+    codebuf_free(&header);
+
+    // 每个单元先查目标文件缓存，没命中的才写出源文件交给gcc
+    char flags[PATH_MAX + 64];
+    snprintf(flags, sizeof(flags), "-c -x c prelude=%d %s", (int)options->prelude,
+             options->prelude == PRELUDE_PCH ? options->prelude_path : "");
+    int reused = 0;
+    for (int i = 0; i < unit_count && status == 0; i++)
+    {
+        if (report)
+            report->c_bytes += units[i].code.length;
+        if (units[i].code.failed)
+            status = -1;
+        else if (options->cache && object_key(&units[i], flags, units[i].key) == 0 &&
+                 cache_lookup(options->cache, units[i].key, units[i].object_path))
+        {
+            units[i].cached = 1;
+            reused++;
+        }
+        else
+            status = write_unit_file(units[i].source_path, &units[i].code);
+    }
+    phase_end(report, PHASE_CODEGEN, &timer);
+    if (status != 0)
+        fprintf(diag, "Error: cannot write translation units to %s: %s\n", dir, strerror(errno));
+
+    // 最多K个gcc -c同时运行，然后链接
+    phase_begin(report, &timer);
+    int to_compile = unit_count - reused;
+    if (status == 0 && to_compile > 0)
+    {
+        ThreadPool *pool = threadpool_create(to_compile < k ? to_compile : k);
+        for (int i = 0; i < unit_count; i++)
+        {
+            if (!units[i].cached)
+                threadpool_submit(pool, compile_unit, &units[i]);
+        }
+        threadpool_wait(pool);
+        threadpool_destroy(pool);
+        for (int i = 0; i < unit_count; i++)
+        {
+            if (units[i].status != 0)
+                status = -1;
+        }
+    }
+    TRACE(TRACE_DRIVER, "%d translation units: %d compiled, %d reused from the cache",
+          unit_count, to_compile, reused);
+    if (status == 0)
+    {
+        char **argv = arena_alloc(&arena, (unit_count + 4) * sizeof(char *));
+        int argc = 0;
+        argv[argc++] = CC_PROGRAM;
+        argv[argc++] = "-o";
+        argv[argc++] = (char *)output_name;
+        for (int i = 0; i < unit_count; i++)
+            argv[argc++] = units[i].object_path;
+        argv[argc] = NULL;
+        status = run_command(argv, diag);
+    }
+    phase_end(report, PHASE_CC, &timer);
+    if (options->show_stats)
+        fprintf(diag, "split: %d translation units, %d compiled, %d reused\n", unit_count, to_compile, reused);
+
+    remove_work_dir(dir, units, unit_count, header_path);
+    for (int i = 0; i < unit_count; i++)
+        codebuf_free(&units[i].code);
+    arena_free(&arena);
+    return status;
+}
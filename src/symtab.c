@@ -0,0 +1,90 @@
+#include "symtab.h"
+#include <string.h>
+
+#define SYMTAB_MIN_CAPACITY 16
+
+// FNV-1a
+static uint64_t hash_name(const char *name, size_t length)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < length; i++)
+    {
+        hash ^= (unsigned char)name[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static Symbol *allocate_slots(Arena *arena, size_t capacity)
+{
+    Symbol *slots = arena_alloc(arena, capacity * sizeof(Symbol));
+    memset(slots, 0, capacity * sizeof(Symbol));
+    return slots;
+}
+
+void symtab_init(SymbolTable *table, Arena *arena, size_t expected)
+{
+    size_t capacity = SYMTAB_MIN_CAPACITY;
+    while (capacity < expected * 2)
+        capacity *= 2;
+    table->arena = arena;
+    table->slots = allocate_slots(arena, capacity);
+    table->capacity = capacity;
+    table->count = 0;
+}
+
+// 返回名字所在的槽，或者应该插入的空槽
+static Symbol *find_slot(Symbol *slots, size_t capacity, const char *name, size_t length, uint64_t hash)
+{
+    size_t mask = capacity - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask)
+    {
+        Symbol *slot = &slots[i];
+        if (!slot->name)
+            return slot;
+        if (slot->hash == hash && slot->length == length &&
+            (slot->name == name || memcmp(slot->name, name, length) == 0))
+            return slot;
+    }
+}
+
+static void grow(SymbolTable *table)
+{
+    size_t capacity = table->capacity * 2;
+    Symbol *slots = allocate_slots(table->arena, capacity);
+    for (size_t i = 0; i < table->capacity; i++)
+    {
+        Symbol *old = &table->slots[i];
+        if (old->name)
+            *find_slot(slots, capacity, old->name, old->length, old->hash) = *old;
+    }
+    table->slots = slots;
+    table->capacity = capacity;
+}
+
+Symbol *symtab_lookup(const SymbolTable *table, const char *name, size_t length)
+{
+    Symbol *slot = find_slot(table->slots, table->capacity, name, length, hash_name(name, length));
+    return slot->name ? slot : NULL;
+}
+
+Symbol *symtab_intern(SymbolTable *table, const char *name, size_t length)
+{
+    uint64_t hash = hash_name(name, length);
+    Symbol *slot = find_slot(table->slots, table->capacity, name, length, hash);
+    if (slot->name)
+        return slot;
+
+    if ((table->count + 1) * 2 > table->capacity)
+    {
+        grow(table);
+        slot = find_slot(table->slots, table->capacity, name, length, hash);
+    }
+    slot->name = name;
+    slot->length = length;
+    slot->hash = hash;
+    slot->value = NULL;
+    slot->line = 0;
+    table->count++;
+    return slot;
+}
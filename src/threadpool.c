@@ -0,0 +1,117 @@
+#include "threadpool.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+int cpu_count(void)
+{
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (int)n : 1;
+}
+
+static void *worker_main(void *arg)
+{
+    ThreadPool *pool = arg;
+    pthread_mutex_lock(&pool->lock);
+    for (;;)
+    {
+        while (!pool->head && !pool->stopping)
+            pthread_cond_wait(&pool->task_ready, &pool->lock);
+        if (!pool->head)
+            break; // 正在停止且队列已空
+
+        ThreadPoolTask *task = pool->head;
+        pool->head = task->next;
+        if (!pool->head)
+            pool->tail = NULL;
+        pthread_mutex_unlock(&pool->lock);
+
+        task->fn(task->arg);
+        free(task);
+
+        pthread_mutex_lock(&pool->lock);
+        if (--pool->pending == 0)
+            pthread_cond_broadcast(&pool->idle);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return NULL;
+}
+
+ThreadPool *threadpool_create(int thread_count)
+{
+    if (thread_count <= 0)
+        thread_count = cpu_count();
+
+    ThreadPool *pool = calloc(1, sizeof(ThreadPool));
+    if (pool)
+        pool->threads = malloc(thread_count * sizeof(pthread_t));
+    if (!pool || !pool->threads)
+    {
+        fprintf(stderr, "Error: Out of memory (thread pool)\n");
+        exit(1);
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->task_ready, NULL);
+    pthread_cond_init(&pool->idle, NULL);
+
+    for (int i = 0; i < thread_count; i++)
+    {
+        if (pthread_create(&pool->threads[i], NULL, worker_main, pool) != 0)
+            break;
+        pool->thread_count++;
+    }
+    if (pool->thread_count == 0)
+    {
+        fprintf(stderr, "Error: cannot create worker threads\n");
+        exit(1);
+    }
+    return pool;
+}
+
+void threadpool_submit(ThreadPool *pool, ThreadTask fn, void *arg)
+{
+    ThreadPoolTask *task = malloc(sizeof(ThreadPoolTask));
+    if (!task)
+    {
+        fprintf(stderr, "Error: Out of memory (thread pool task)\n");
+        exit(1);
+    }
+    task->fn = fn;
+    task->arg = arg;
+    task->next = NULL;
+
+    pthread_mutex_lock(&pool->lock);
+    if (pool->tail)
+        pool->tail->next = task;
+    else
+        pool->head = task;
+    pool->tail = task;
+    pool->pending++;
+    pthread_cond_signal(&pool->task_ready);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void threadpool_wait(ThreadPool *pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    while (pool->pending > 0)
+        pthread_cond_wait(&pool->idle, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void threadpool_destroy(ThreadPool *pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = 1;
+    pthread_cond_broadcast(&pool->task_ready);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->thread_count; i++)
+        pthread_join(pool->threads[i], NULL);
+
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->task_ready);
+    pthread_cond_destroy(&pool->idle);
+    free(pool->threads);
+    free(pool);
+}
@@ -0,0 +1,123 @@
+#include "timereport.h"
+#include <sys/resource.h>
+
+static const char *const phase_names[PHASE_COUNT] = {
+    [PHASE_READ] = "read",
+    [PHASE_HEADER] = "separate_header",
+    [PHASE_LEX] = "lex",
+    [PHASE_PARSE] = "parse",
+    [PHASE_OPTIMIZE] = "optimize",
+    [PHASE_CODEGEN] = "codegen",
+    [PHASE_CC] = "cc",
+    [PHASE_RUN] = "run",
+};
+
+static double timespec_ms(const struct timespec *t)
+{
+    return t->tv_sec * 1e3 + t->tv_nsec / 1e6;
+}
+
+// 已经结束并被等待过的子进程（gcc、cc1、as、ld）用掉的CPU时间
+static double children_cpu_ms(void)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_CHILDREN, &usage);
+    return (usage.ru_utime.tv_sec + usage.ru_stime.tv_sec) * 1e3 +
+           (usage.ru_utime.tv_usec + usage.ru_stime.tv_usec) / 1e3;
+}
+
+void phase_begin(const TimeReport *report, PhaseTimer *timer)
+{
+    if (!report)
+        return;
+    clock_gettime(CLOCK_MONOTONIC, &timer->wall);
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &timer->cpu);
+    timer->child_cpu_ms = children_cpu_ms();
+}
+
+void phase_end(TimeReport *report, Phase phase, const PhaseTimer *timer)
+{
+    if (!report)
+        return;
+    struct timespec wall, cpu;
+    clock_gettime(CLOCK_MONOTONIC, &wall);
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpu);
+    report->wall_ms[phase] += timespec_ms(&wall) - timespec_ms(&timer->wall);
+    report->cpu_ms[phase] += timespec_ms(&cpu) - timespec_ms(&timer->cpu) +
+                             children_cpu_ms() - timer->child_cpu_ms;
+}
+
+static void collect_rss(TimeReport *report)
+{
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    report->peak_rss_kb = usage.ru_maxrss;
+    getrusage(RUSAGE_CHILDREN, &usage);
+    report->cc_peak_rss_kb = usage.ru_maxrss;
+}
+
+static void print_text(const TimeReport *report, const char *source_path, FILE *out)
+{
+    double total_wall = 0, total_cpu = 0;
+    fprintf(out, "time report for %s:\n", source_path);
+    fprintf(out, "  %-16s %10s %10s\n", "phase", "wall ms", "cpu ms");
+    for (int i = 0; i < PHASE_COUNT; i++)
+    {
+        fprintf(out, "  %-16s %10.3f %10.3f\n", phase_names[i], report->wall_ms[i], report->cpu_ms[i]);
+        total_wall += report->wall_ms[i];
+        total_cpu += report->cpu_ms[i];
+    }
+    fprintf(out, "  %-16s %10.3f %10.3f\n", "total", total_wall, total_cpu);
+
+    fprintf(out, "  bytes read:      %zu\n", report->bytes_read);
+    fprintf(out, "  tokens:          %zu", report->token_total);
+    const char *separator = " (";
+    for (int i = 0; i < TOKEN_TYPE_COUNT; i++)
+    {
+        if (report->tokens[i] == 0)
+            continue;
+        fprintf(out, "%s%s %zu", separator, token_type_to_string((TokenType)i), report->tokens[i]);
+        separator = ", ";
+    }
+    fprintf(out, "%s\n", report->token_total ? ")" : "");
+    fprintf(out, "  AST nodes:       %d\n", report->ast_nodes);
+    fprintf(out, "  functions:       %d\n", report->functions);
+    fprintf(out, "  C bytes:         %zu\n", report->c_bytes);
+    fprintf(out, "  peak RSS:        %.1f MB (C compiler %.1f MB)\n",
+            report->peak_rss_kb / 1024.0, report->cc_peak_rss_kb / 1024.0);
+}
+
+static void print_json(const TimeReport *report, const char *source_path, FILE *out)
+{
+    fputs("{\"file\": \"", out);
+    for (const char *p = source_path; *p; p++)
+    {
+        if (*p == '"' || *p == '\\')
+            fputc('\\', out);
+        fputc(*p, out);
+    }
+    fputs("\", \"phases\": {", out);
+    for (int i = 0; i < PHASE_COUNT; i++)
+        fprintf(out, "%s\"%s\": {\"wall_ms\": %.4f, \"cpu_ms\": %.4f}", i ? ", " : "", phase_names[i],
+                report->wall_ms[i], report->cpu_ms[i]);
+    fprintf(out, "}, \"counters\": {\"bytes_read\": %zu, \"tokens\": {\"total\": %zu", report->bytes_read,
+            report->token_total);
+    for (int i = 0; i < TOKEN_TYPE_COUNT; i++)
+    {
+        if (report->tokens[i])
+            fprintf(out, ", \"%s\": %zu", token_type_to_string((TokenType)i), report->tokens[i]);
+    }
+    fprintf(out, "}, \"ast_nodes\": %d, \"functions\": %d, \"c_bytes\": %zu, "
+                 "\"peak_rss_kb\": %ld, \"cc_peak_rss_kb\": %ld}}\n",
+            report->ast_nodes, report->functions, report->c_bytes, report->peak_rss_kb,
+            report->cc_peak_rss_kb);
+}
+
+void time_report_print(TimeReport *report, const char *source_path, int json, FILE *out)
+{
+    collect_rss(report);
+    if (json)
+        print_json(report, source_path, out);
+    else
+        print_text(report, source_path, out);
+}
@@ -0,0 +1,208 @@
+#define _GNU_SOURCE // pipe2
+#include "toolchain.h"
+#include "trace.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <spawn.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+extern char **environ;
+
+static void trace_command(char *const argv[])
+{
+#ifndef HERCODE_NO_TRACE
+    if (!TRACE_ENABLED(TRACE_CODEGEN))
+        return;
+    char line[1024];
+    size_t used = 0;
+    line[0] = '\0';
+    for (int i = 0; argv[i] && used < sizeof(line); i++)
+        used += snprintf(line + used, sizeof(line) - used, "%s%s", i ? " " : "", argv[i]);
+    TRACE(TRACE_CODEGEN, "Running: %s", line);
+#else
+    (void)argv;
+#endif
+}
+
+// 启动子进程；stdin_fd/stdout_fd/stderr_fd为-1时继承当前进程的
+static int spawn(pid_t *pid, char *const argv[], int stdin_fd, int stdout_fd, int stderr_fd, FILE *diag)
+{
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    if (stdin_fd >= 0)
+        posix_spawn_file_actions_adddup2(&actions, stdin_fd, STDIN_FILENO);
+    if (stdout_fd >= 0)
+        posix_spawn_file_actions_adddup2(&actions, stdout_fd, STDOUT_FILENO);
+    if (stderr_fd >= 0)
+        posix_spawn_file_actions_adddup2(&actions, stderr_fd, STDERR_FILENO);
+
+    trace_command(argv);
+    int err = posix_spawnp(pid, argv[0], &actions, NULL, argv, environ);
+    posix_spawn_file_actions_destroy(&actions);
+    if (err != 0)
+    {
+        fprintf(diag ? diag : stderr, "Error: cannot run %s: %s\n", argv[0], strerror(err));
+        return -1;
+    }
+    return 0;
+}
+
+static int wait_for(pid_t pid)
+{
+    int status;
+    while (waitpid(pid, &status, 0) < 0)
+    {
+        if (errno != EINTR)
+            return -1;
+    }
+    if (WIFEXITED(status))
+        return WEXITSTATUS(status);
+    return -1;
+}
+
+// diag不是stderr时，子进程的stderr先写到临时文件（不在工作目录），结束后再整体转给diag，
+// 这样并发编译的错误信息不会交错在一起
+static FILE *open_capture(FILE *diag)
+{
+    if (!diag || diag == stderr)
+        return NULL;
+    FILE *capture = tmpfile();
+    if (capture)
+        fcntl(fileno(capture), F_SETFD, FD_CLOEXEC); // 只有dup2到子进程stderr的那一份需要继承
+    return capture;
+}
+
+static void flush_capture(FILE *capture, FILE *diag)
+{
+    if (!capture)
+        return;
+    rewind(capture);
+    char buffer[4096];
+    size_t n;
+    while ((n = fread(buffer, 1, sizeof(buffer), capture)) > 0)
+        fwrite(buffer, 1, n, diag);
+    fclose(capture);
+}
+
+int run_command(char *const argv[], FILE *diag)
+{
+    FILE *capture = open_capture(diag);
+    pid_t pid;
+    int status = -1;
+    if (spawn(&pid, argv, -1, -1, capture ? fileno(capture) : -1, diag) == 0)
+        status = wait_for(pid);
+    flush_capture(capture, diag);
+    return status;
+}
+
+int capture_command(char *const argv[], char *buffer, size_t size)
+{
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) != 0)
+        return -1;
+
+    pid_t pid;
+    int err = spawn(&pid, argv, -1, fds[1], -1, NULL);
+    close(fds[1]);
+    if (err != 0)
+    {
+        close(fds[0]);
+        return -1;
+    }
+
+    size_t used = 0;
+    char discard[512];
+    for (;;)
+    {
+        // buffer满了之后继续读完，避免子进程阻塞在写管道上
+        char *dst = used + 1 < size ? buffer + used : discard;
+        size_t room = used + 1 < size ? size - used - 1 : sizeof(discard);
+        ssize_t n = read(fds[0], dst, room);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        if (dst != discard)
+            used += (size_t)n;
+    }
+    close(fds[0]);
+    if (size > 0)
+        buffer[used] = '\0';
+    return wait_for(pid);
+}
+
+static pthread_once_t version_once = PTHREAD_ONCE_INIT;
+static char version_text[1024];
+static int version_status = -1;
+
+static void query_cc_version(void)
+{
+    char *argv[] = {CC_PROGRAM, "--version", NULL};
+    version_status = capture_command(argv, version_text, sizeof(version_text));
+}
+
+int cc_version(char *buffer, size_t size)
+{
+    pthread_once(&version_once, query_cc_version);
+    if (version_status != 0)
+        return -1;
+    snprintf(buffer, size, "%s", version_text);
+    return 0;
+}
+
+int compile_begin(CompileJob *job, const char *output_name, char *const extra_args[], FILE *diag)
+{
+    char *argv[32] = {CC_PROGRAM, "-x", "c"};
+    int argc = 3;
+    for (int i = 0; extra_args && extra_args[i] && argc < 28; i++)
+        argv[argc++] = extra_args[i];
+    argv[argc++] = "-o";
+    argv[argc++] = (char *)output_name;
+    argv[argc++] = "-";
+    argv[argc] = NULL;
+
+    job->diag = diag ? diag : stderr;
+
+    // 两端都设置CLOEXEC，避免同时运行的其他子进程继承写端导致gcc等不到EOF
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) != 0)
+    {
+        fprintf(job->diag, "Error creating pipe to C compiler: %s\n", strerror(errno));
+        return -1;
+    }
+
+    job->capture = open_capture(diag);
+    int err = spawn(&job->pid, argv, fds[0], -1, job->capture ? fileno(job->capture) : -1, job->diag);
+    close(fds[0]);
+    if (err != 0)
+    {
+        close(fds[1]);
+        flush_capture(job->capture, job->diag);
+        return -1;
+    }
+
+    job->input = fdopen(fds[1], "w");
+    if (!job->input)
+    {
+        fprintf(job->diag, "Error opening pipe to C compiler: %s\n", strerror(errno));
+        close(fds[1]);
+        wait_for(job->pid);
+        flush_capture(job->capture, job->diag);
+        return -1;
+    }
+    return 0;
+}
+
+int compile_end(CompileJob *job)
+{
+    // gcc提前退出时写管道会失败，这里只关心它的退出码
+    fclose(job->input);
+    job->input = NULL;
+    int status = wait_for(job->pid);
+    flush_capture(job->capture, job->diag);
+    job->capture = NULL;
+    return status;
+}
@@ -0,0 +1,71 @@
+#include "trace.h"
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+unsigned trace_mask = 0;
+
+static const struct
+{
+    const char *name;
+    TraceCategory category;
+} trace_names[] = {
+    {"lexer", TRACE_LEXER},
+    {"parser", TRACE_PARSER},
+    {"codegen", TRACE_CODEGEN},
+    {"driver", TRACE_DRIVER},
+    {"all", TRACE_ALL},
+};
+
+int trace_parse(const char *spec)
+{
+    unsigned mask = 0;
+    while (*spec)
+    {
+        size_t len = strcspn(spec, ",");
+        size_t i;
+        for (i = 0; i < sizeof(trace_names) / sizeof(trace_names[0]); i++)
+        {
+            if (strlen(trace_names[i].name) == len && strncmp(spec, trace_names[i].name, len) == 0)
+            {
+                mask |= trace_names[i].category;
+                break;
+            }
+        }
+        if (i == sizeof(trace_names) / sizeof(trace_names[0]))
+            return -1;
+        spec += len;
+        if (*spec == ',')
+            spec++;
+    }
+    trace_mask |= mask;
+    return 0;
+}
+
+static const char *trace_prefix(TraceCategory category)
+{
+    switch (category)
+    {
+    case TRACE_LEXER:
+        return "lexer";
+    case TRACE_PARSER:
+        return "parser";
+    case TRACE_CODEGEN:
+        return "codegen";
+    case TRACE_DRIVER:
+        return "driver";
+    default:
+        return "trace";
+    }
+}
+
+void trace_printf(TraceCategory category, const char *format, ...)
+{
+    // 跟踪信息写到stderr，不会混进程序的正常输出
+    va_list args;
+    va_start(args, format);
+    fprintf(stderr, "[%s] ", trace_prefix(category));
+    vfprintf(stderr, format, args);
+    fputc('\n', stderr);
+    va_end(args);
+}
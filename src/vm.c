@@ -0,0 +1,288 @@
+#include "vm.h"
+#include "codegen.h"
+#include "trace.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// 返回地址栈从堆上分配，满了翻倍。HerCode没有条件语句，递归一定是无限递归，
+// 深度超过上限时停下来（-O0不检查递归）。上限和原生程序8 MiB的栈能容纳的调用深度相当，
+// 栈最多占4 MiB
+#define VM_INITIAL_CALL_DEPTH (1 << 16)
+#define VM_MAX_CALL_DEPTH (1 << 20)
+#define VM_OUTPUT_BUFFER (64 * 1024)
+
+typedef struct
+{
+    uint32_t *code;
+    size_t size, capacity;
+    VMConstant *constants;
+    size_t constant_count, constant_capacity;
+    size_t *call_sites; // OP_CALL操作数的位置，操作数暂存函数下标
+    size_t call_site_count, call_site_capacity;
+} VMBuilder;
+
+static void *grow(void *data, size_t *capacity, size_t element_size)
+{
+    *capacity = *capacity ? *capacity * 2 : 64;
+    void *grown = realloc(data, *capacity * element_size);
+    if (!grown)
+    {
+        fprintf(stderr, "Error: Out of memory (bytecode)\n");
+        exit(1);
+    }
+    return grown;
+}
+
+static void emit(VMBuilder *b, uint32_t word)
+{
+    if (b->size == b->capacity)
+        b->code = grow(b->code, &b->capacity, sizeof(uint32_t));
+    b->code[b->size++] = word;
+}
+
+static int compile_statements(VMBuilder *b, ASTNode **stmts, int count, const FunctionTable *functions,
+                              Arena *arena, FILE *diag)
+{
+    for (int i = 0; i < count;)
+    {
+        if (stmts[i]->type == STMT_SAY)
+        {
+            // 连续的say在编译时拼成一个常量，执行时只需一次拷贝
+            size_t length = 0;
+            int end = i;
+            while (end < count && stmts[end]->type == STMT_SAY)
+                length += stmts[end++]->length + 1;
+            char *text = arena_alloc(arena, length);
+            size_t used = 0;
+            for (; i < end; i++)
+            {
+                memcpy(text + used, stmts[i]->value, stmts[i]->length);
+                used += stmts[i]->length;
+                text[used++] = '\n';
+            }
+
+            if (b->constant_count == b->constant_capacity)
+                b->constants = grow(b->constants, &b->constant_capacity, sizeof(VMConstant));
+            b->constants[b->constant_count].text = text;
+            b->constants[b->constant_count].length = length;
+            emit(b, OP_PRINT);
+            emit(b, (uint32_t)b->constant_count++);
+            continue;
+        }
+
+        if (stmts[i]->type == STMT_FUNCTION_CALL)
+        {
+            FunctionDef *def = find_function(functions, stmts[i]->value, stmts[i]->length);
+            if (!def)
+            {
+                fprintf(diag, "Error: call to undefined function '%.*s'\n", (int)stmts[i]->length, stmts[i]->value);
+                return -1;
+            }
+            emit(b, OP_CALL);
+            if (b->call_site_count == b->call_site_capacity)
+                b->call_sites = grow(b->call_sites, &b->call_site_capacity, sizeof(size_t));
+            b->call_sites[b->call_site_count++] = b->size;
+            emit(b, (uint32_t)(def - functions->defs));
+        }
+        i++;
+    }
+    return 0;
+}
+
+BytecodeProgram *vm_compile(ASTNode **nodes, int count, Arena *arena, FILE *diag)
+{
+    FunctionTable functions;
+    build_function_table(&functions, nodes, count, arena);
+    int function_count = functions.count;
+    size_t *entries = arena_alloc(arena, (function_count + 1) * sizeof(size_t));
+
+    VMBuilder b;
+    memset(&b, 0, sizeof(b));
+    int status = compile_statements(&b, nodes, count, &functions, arena, diag);
+    emit(&b, OP_HALT);
+    for (int i = 0; i < function_count && status == 0; i++)
+    {
+        entries[i] = b.size;
+        status = compile_statements(&b, functions.defs[i].body, functions.defs[i].body_count,
+                                    &functions, arena, diag);
+        emit(&b, OP_RET);
+    }
+
+    BytecodeProgram *program = NULL;
+    if (status == 0)
+    {
+        // 把CALL的操作数从函数下标改成入口地址
+        for (size_t i = 0; i < b.call_site_count; i++)
+            b.code[b.call_sites[i]] = (uint32_t)entries[b.code[b.call_sites[i]]];
+
+        program = arena_alloc(arena, sizeof(BytecodeProgram));
+        program->code = arena_alloc(arena, b.size * sizeof(uint32_t));
+        memcpy(program->code, b.code, b.size * sizeof(uint32_t));
+        program->code_size = b.size;
+        program->constants = arena_alloc(arena, (b.constant_count + 1) * sizeof(VMConstant));
+        if (b.constant_count)
+            memcpy(program->constants, b.constants, b.constant_count * sizeof(VMConstant));
+        program->constant_count = b.constant_count;
+        TRACE(TRACE_CODEGEN, "bytecode: %zu words, %zu constants, %d functions",
+              program->code_size, program->constant_count, function_count);
+    }
+    free(b.code);
+    free(b.constants);
+    free(b.call_sites);
+    return program;
+}
+
+typedef struct
+{
+    int fd;
+    size_t used;
+    int failed;
+    int error; // 第一次写失败时的errno
+    char data[VM_OUTPUT_BUFFER];
+} OutputBuffer;
+
+static void output_fail(OutputBuffer *out, ssize_t n)
+{
+    out->failed = 1;
+    out->error = n < 0 ? errno : EIO; // write返回0时没有设置errno
+}
+
+static void output_flush(OutputBuffer *out)
+{
+    size_t done = 0;
+    while (done < out->used && !out->failed)
+    {
+        ssize_t n = write(out->fd, out->data + done, out->used - done);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            output_fail(out, n);
+        else
+            done += (size_t)n;
+    }
+    out->used = 0;
+}
+
+static void output_write(OutputBuffer *out, const char *text, size_t length)
+{
+    if (out->used + length > sizeof(out->data))
+    {
+        output_flush(out);
+        // 比缓冲区还大的常量直接写
+        if (length > sizeof(out->data))
+        {
+            size_t done = 0;
+            while (done < length && !out->failed)
+            {
+                ssize_t n = write(out->fd, text + done, length - done);
+                if (n < 0 && errno == EINTR)
+                    continue;
+                if (n <= 0)
+                    output_fail(out, n);
+                else
+                    done += (size_t)n;
+            }
+            return;
+        }
+    }
+    memcpy(out->data + out->used, text, length);
+    out->used += length;
+}
+
+int vm_run(const BytecodeProgram *program, int fd, FILE *diag)
+{
+    OutputBuffer *out = malloc(sizeof(OutputBuffer));
+    int stack_capacity = VM_INITIAL_CALL_DEPTH;
+    uint32_t *stack = malloc(stack_capacity * sizeof(uint32_t));
+    if (!out || !stack)
+    {
+        free(out);
+        free(stack);
+        fprintf(diag, "Error: Out of memory (vm)\n");
+        return 1;
+    }
+    out->fd = fd;
+    out->used = 0;
+    out->failed = 0;
+    out->error = 0;
+
+    const uint32_t *code = program->code;
+    const VMConstant *constants = program->constants;
+    size_t pc = 0;
+    int sp = 0;
+    int status = 0;
+
+#if defined(__GNUC__)
+    // computed goto：每条指令末尾直接跳到下一条的处理代码
+    static void *const dispatch[] = {&&op_print, &&op_call, &&op_ret, &&op_halt};
+#define DISPATCH() goto *dispatch[code[pc]]
+#define CASE(label, op) op_##label:
+#else
+#define DISPATCH() continue
+#define CASE(label, op) case op:
+#endif
+
+#if defined(__GNUC__)
+    DISPATCH();
+#else
+    for (;;)
+    {
+        switch (code[pc])
+        {
+#endif
+    CASE(print, OP_PRINT)
+    {
+        const VMConstant *constant = &constants[code[pc + 1]];
+        output_write(out, constant->text, constant->length);
+        pc += 2;
+        DISPATCH();
+    }
+    CASE(call, OP_CALL)
+    {
+        if (sp == stack_capacity)
+        {
+            uint32_t *grown = stack_capacity < VM_MAX_CALL_DEPTH
+                                  ? realloc(stack, 2 * (size_t)stack_capacity * sizeof(uint32_t))
+                                  : NULL;
+            if (!grown)
+            {
+                fprintf(diag, "Error: call depth exceeds %d\n", stack_capacity);
+                status = 1;
+                goto done;
+            }
+            stack = grown;
+            stack_capacity *= 2;
+        }
+        stack[sp++] = (uint32_t)(pc + 2);
+        pc = code[pc + 1];
+        DISPATCH();
+    }
+    CASE(ret, OP_RET)
+    {
+        pc = stack[--sp];
+        DISPATCH();
+    }
+    CASE(halt, OP_HALT)
+    {
+        goto done;
+    }
+#if !defined(__GNUC__)
+        }
+    }
+#endif
+#undef DISPATCH
+#undef CASE
+
+done:
+    output_flush(out);
+    if (out->failed)
+    {
+        fprintf(diag, "Error writing program output: %s\n", strerror(out->error));
+        status = 1;
+    }
+    free(out);
+    free(stack);
+    return status;
+}
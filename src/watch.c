@@ -0,0 +1,432 @@
+#include "watch.h"
+#include "codegen.h"
+#include "codegen_x86.h"
+#include "lexer.h"
+#include "optimize.h"
+#include "parser.h"
+#include "symtab.h"
+#include "toolchain.h"
+#include "trace.h"
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <time.h>
+#include <unistd.h>
+
+// 一个片段：从第0列的function行开始到下一个这样的行之前；
+// 第一个function之前的内容和从start:开始的部分各自是一个片段
+typedef struct
+{
+    char *text; // 片段源码的副本，以'\0'结尾；AST里的字符串指向这里
+    size_t length;
+    int is_start;
+    int ok;      // 解析成功
+    int taken;   // 本次重建已经复用
+    Arena arena; // 片段的AST
+    ASTNode **nodes;
+    int count;
+    CodeBuffer *code; // 一个函数实现的C代码，和nodes一一对应，只有函数定义有内容
+} Region;
+
+typedef struct
+{
+    Region **regions;
+    int count;
+} WatchState;
+
+typedef struct
+{
+    const char *text;
+    size_t length;
+    int line; // 片段第一行在整个文件中的行号
+    int is_start;
+} RegionSpan;
+
+typedef struct
+{
+    int reparsed;
+    int regenerated;
+    int total;
+    struct timespec start;
+    double frontend_ms; // 从收到事件到开始调用gcc或原生后端
+} RebuildStats;
+
+static double elapsed_ms(const struct timespec *start)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (double)(now.tv_sec - start->tv_sec) * 1e3 + (double)(now.tv_nsec - start->tv_nsec) / 1e6;
+}
+
+static void free_region(Region *region)
+{
+    for (int i = 0; region->code && i < region->count; i++)
+        codebuf_free(&region->code[i]);
+    free(region->code);
+    arena_free(&region->arena);
+    free(region->text);
+    free(region);
+}
+
+static int starts_line_with(const char *line, const char *end, const char *word)
+{
+    size_t length = strlen(word);
+    return (size_t)(end - line) >= length && memcmp(line, word, length) == 0;
+}
+
+// 按第0列的function/start:行切分；返回片段数，spans由调用者释放
+static int split_regions(const char *source, int first_line, RegionSpan **spans)
+{
+    int capacity = 16;
+    int count = 0;
+    *spans = malloc(capacity * sizeof(RegionSpan));
+    const char *region_start = source;
+    int region_line = first_line;
+    int line = first_line;
+    for (const char *p = source; *p;)
+    {
+        const char *end = strchr(p, '\n');
+        if (!end)
+            end = p + strlen(p);
+        int is_function = starts_line_with(p, end, "function") && (p[8] == ' ' || p[8] == '\t');
+        int is_start = starts_line_with(p, end, "start:");
+        if ((is_function || is_start) && p > region_start)
+        {
+            if (count == capacity)
+                *spans = realloc(*spans, (capacity *= 2) * sizeof(RegionSpan));
+            (*spans)[count++] = (RegionSpan){region_start, (size_t)(p - region_start), region_line, 0};
+            region_start = p;
+            region_line = line;
+        }
+        if (is_start)
+            break; // start:之后的内容都属于最后一个片段
+        p = *end ? end + 1 : end;
+        line++;
+    }
+    if (count == capacity)
+        *spans = realloc(*spans, (capacity + 1) * sizeof(RegionSpan));
+    size_t rest = strlen(region_start);
+    (*spans)[count++] = (RegionSpan){region_start, rest, region_line, strncmp(region_start, "start:", 6) == 0};
+    return count;
+}
+
+static int same_region(const Region *region, const RegionSpan *span)
+{
+    return region->ok && region->is_start == span->is_start && region->length == span->length &&
+           memcmp(region->text, span->text, span->length) == 0;
+}
+
+static Region *parse_region(const RegionSpan *span, const char *source_path, RebuildStats *stats)
+{
+    Region *region = calloc(1, sizeof(Region));
+    region->text = malloc(span->length + 1);
+    memcpy(region->text, span->text, span->length);
+    region->text[span->length] = '\0';
+    region->length = span->length;
+    region->is_start = span->is_start;
+    // 片段通常很小，按源码长度估计第一个块，避免每个片段都占一个64KiB的块
+    arena_init_sized(&region->arena, 4096 + span->length * 4);
+
+    Lexer *lexer = new_lexer(region->text, &region->arena);
+    Parser *parser = new_parser(lexer);
+    parser->filename = source_path;
+    parser->first_line = span->line;
+    region->nodes = span->is_start ? parse_program(parser, &region->count)
+                                   : parse_definitions(parser, &region->count);
+    region->ok = region->nodes != NULL;
+    stats->reparsed++;
+    if (!region->ok)
+        return region;
+
+    // 只为这个片段里的函数重新生成C代码
+    region->code = calloc(region->count + 1, sizeof(CodeBuffer));
+    for (int i = 0; i < region->count; i++)
+    {
+        ASTNode *node = region->nodes[i];
+        if (node->type != STMT_FUNCTION_DEF)
+            continue;
+        FunctionDef def = {node->value, node->length, node->body, node->body_count};
+        codebuf_init(&region->code[i], 256);
+        write_function_definition(&region->code[i], &def);
+        if (region->code[i].failed)
+        {
+            region->ok = 0;
+            return region;
+        }
+        stats->regenerated++;
+    }
+    return region;
+}
+
+// 用当前的片段生成整个程序并编译；C代码由缓存的函数实现拼起来
+static int build_program(WatchState *state, const char *c_header, const char *source_path,
+                         const char *output_name, const CompileOptions *options, RebuildStats *stats)
+{
+    Arena arena;
+    arena_init(&arena);
+    int total = 0;
+    for (int i = 0; i < state->count; i++)
+        total += state->regions[i]->count;
+    ASTNode **nodes = arena_alloc(&arena, (total + 1) * sizeof(ASTNode *));
+    int count = 0;
+
+    // 函数名 -> 生成好的C代码；同时检查跨片段的重复定义
+    SymbolTable generated;
+    symtab_init(&generated, &arena, total);
+    int status = 0;
+    for (int i = 0; i < state->count; i++)
+    {
+        Region *region = state->regions[i];
+        for (int j = 0; j < region->count; j++)
+        {
+            ASTNode *node = region->nodes[j];
+            nodes[count++] = node;
+            if (node->type != STMT_FUNCTION_DEF)
+                continue;
+            Symbol *symbol = symtab_intern(&generated, node->value, node->length);
+            if (symbol->value)
+            {
+                fprintf(stderr, "%s: Error: function '%.*s' is defined more than once\n",
+                        source_path, (int)node->length, node->value);
+                status = 1;
+            }
+            symbol->value = &region->code[j];
+        }
+    }
+
+    // 内联会把函数体复制到调用者里，使按函数缓存的代码失效，所以最多做到-O1
+    OptimizeStats opt_stats;
+    OptLevel level = options->opt_level > OPT_BASIC ? OPT_BASIC : options->opt_level;
+    if (status == 0 && optimize_program(&nodes, &count, c_header, level, &arena, source_path,
+                                        stderr, &opt_stats) != 0)
+        status = 1;
+
+    stats->frontend_ms = elapsed_ms(&stats->start);
+    if (status == 0 && options->backend == BACKEND_NATIVE && !c_header)
+    {
+        status = generate_native_executable(nodes, count, output_name, stderr) != 0;
+    }
+    else if (status == 0)
+    {
+        char *extra_args[] = {"-include", (char *)options->prelude_path, NULL};
+        CompileJob job;
+        if (compile_begin(&job, output_name, options->prelude == PRELUDE_PCH ? extra_args : NULL, NULL) != 0)
+        {
+            arena_free(&arena);
+            return 1;
+        }
+        // 开头部分（prelude、声明和main）每次重新生成，函数实现直接用缓存的缓冲区，一起writev进管道
+        CodeBuffer head;
+        codebuf_init(&head, 1 << 16);
+        write_prelude(&head, options->prelude, c_header);
+        codebuf_append_literal(&head, "\n/* Function declarations */\n");
+        int function_count = 0;
+        for (int i = 0; i < count; i++)
+        {
+            if (nodes[i]->type != STMT_FUNCTION_DEF)
+                continue;
+            FunctionDef def = {nodes[i]->value, nodes[i]->length, nodes[i]->body, nodes[i]->body_count};
+            write_function_declaration(&head, &def);
+            function_count++;
+        }
+        write_main_function(&head, c_header, nodes, count);
+        codebuf_append_literal(&head, "\n/* Function implementations */\n");
+
+        CodeBuffer **pieces = arena_alloc(&arena, (function_count + 1) * sizeof(CodeBuffer *));
+        int piece_count = 0;
+        pieces[piece_count++] = &head;
+        for (int i = 0; i < count; i++)
+        {
+            if (nodes[i]->type == STMT_FUNCTION_DEF)
+                pieces[piece_count++] = symtab_lookup(&generated, nodes[i]->value, nodes[i]->length)->value;
+        }
+        codebuf_writev(pieces, piece_count, fileno(job.input));
+        codebuf_free(&head);
+        status = compile_end(&job) != 0;
+        if (status)
+            fprintf(stderr, "Error: C compiler failed for %s\n", source_path);
+    }
+
+    arena_free(&arena);
+    return status;
+}
+
+// 重新读取源文件，只解析内容变了的片段，然后重新编译
+static int rebuild(WatchState *state, const char *source_path, const char *output_name,
+                   const CompileOptions *options, RebuildStats *stats, const struct timespec *start)
+{
+    memset(stats, 0, sizeof(*stats));
+    stats->start = *start;
+    // 不映射：编辑器保存时可能正在截断文件
+    SourceFile file;
+    if (source_read(source_path, &file) != 0)
+    {
+        fprintf(stderr, "Error reading file: %s: %s\n", source_path, strerror(errno));
+        return 1;
+    }
+    char *source = file.data;
+    SourceView header, hercode;
+    separate_header(source, file.length, HERCODE_MAGIC, &header, &hercode);
+    const char *c_header = NULL;
+    if (header.data)
+    {
+        source[header.length] = '\0'; // 分隔行不再需要，C头就地结尾
+        c_header = source;
+    }
+    const char *hercode_source = hercode.data;
+    int first_line = 1;
+    for (const char *p = source; p < hercode_source; p++)
+    {
+        if (*p == '\n')
+            first_line++;
+    }
+
+    RegionSpan *spans;
+    int span_count = split_regions(hercode_source, first_line, &spans);
+    Region **regions = calloc(span_count + 1, sizeof(Region *));
+    for (int i = 0; i < state->count; i++)
+        state->regions[i]->taken = 0;
+
+    // 一次编辑通常只改动中间的一小段：先按位置从两头匹配没变的片段，
+    // 剩下的旧片段再按内容建索引，内容相同的直接复用，不管它移动到了哪里
+    int head = 0;
+    while (head < span_count && head < state->count && same_region(state->regions[head], &spans[head]))
+    {
+        regions[head] = state->regions[head];
+        regions[head++]->taken = 1;
+    }
+    int tail = 0;
+    while (tail < span_count - head && tail < state->count - head &&
+           same_region(state->regions[state->count - 1 - tail], &spans[span_count - 1 - tail]))
+    {
+        regions[span_count - 1 - tail] = state->regions[state->count - 1 - tail];
+        regions[span_count - 1 - tail]->taken = 1;
+        tail++;
+    }
+
+    Arena index_arena;
+    arena_init_sized(&index_arena, 4096);
+    SymbolTable index;
+    symtab_init(&index, &index_arena, state->count - head - tail);
+    for (int i = head; i < state->count - tail; i++)
+    {
+        Region *region = state->regions[i];
+        Symbol *symbol = symtab_intern(&index, region->text, region->length);
+        if (region->ok && !symbol->value)
+            symbol->value = region;
+    }
+
+    int status = 0;
+    for (int i = 0; i < span_count; i++)
+    {
+        if (!regions[i])
+        {
+            Symbol *symbol = symtab_lookup(&index, spans[i].text, spans[i].length);
+            Region *old = symbol ? symbol->value : NULL;
+            if (old && !old->taken && old->is_start == spans[i].is_start)
+                regions[i] = old;
+            else
+                regions[i] = parse_region(&spans[i], source_path, stats);
+            regions[i]->taken = 1;
+        }
+        if (!regions[i]->ok)
+            status = 1;
+    }
+    for (int i = 0; i < state->count; i++)
+    {
+        if (!state->regions[i]->taken)
+            free_region(state->regions[i]);
+    }
+    free(state->regions);
+    state->regions = regions;
+    state->count = span_count;
+    stats->total = span_count;
+    free(spans);
+    arena_free(&index_arena);
+
+    if (status == 0)
+        status = build_program(state, c_header, source_path, output_name, options, stats);
+    source_unload(&file);
+    return status;
+}
+
+static void report(int status, const char *output_name, const RebuildStats *stats)
+{
+    double ms = elapsed_ms(&stats->start);
+    if (status == 0)
+        fprintf(stderr, "[watch] rebuilt %s in %.1f ms (front end %.1f ms, %d of %d regions re-parsed, "
+                        "%d functions regenerated)\n",
+                output_name, ms, stats->frontend_ms, stats->reparsed, stats->total, stats->regenerated);
+    else
+        fprintf(stderr, "[watch] build failed after %.1f ms, waiting for changes\n", ms);
+}
+
+int watch_file(const char *source_path, const char *output_name, const CompileOptions *options)
+{
+    // 监视所在目录而不是文件本身：编辑器保存时常常写新文件再rename过来
+    char dir[PATH_MAX] = ".";
+    const char *slash = strrchr(source_path, '/');
+    const char *base = slash ? slash + 1 : source_path;
+    if (slash == source_path)
+        snprintf(dir, sizeof(dir), "/");
+    else if (slash)
+        snprintf(dir, sizeof(dir), "%.*s", (int)(slash - source_path), source_path);
+
+    int fd = inotify_init1(IN_CLOEXEC);
+    if (fd < 0 || inotify_add_watch(fd, dir, IN_CLOSE_WRITE | IN_MOVED_TO) < 0)
+    {
+        fprintf(stderr, "Error watching %s: %s\n", dir, strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        return 1;
+    }
+
+    WatchState state = {0};
+    RebuildStats stats;
+    struct timespec start;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    int status = rebuild(&state, source_path, output_name, options, &stats, &start);
+    report(status, output_name, &stats);
+    fprintf(stderr, "[watch] watching %s for changes (Ctrl-C to stop)\n", source_path);
+
+    char buffer[sizeof(struct inotify_event) + NAME_MAX + 1] __attribute__((aligned(__alignof__(struct inotify_event))));
+    for (;;)
+    {
+        // 等到源文件有变化；计时从收到第一个事件开始
+        int changed = 0;
+        while (!changed)
+        {
+            ssize_t n = read(fd, buffer, sizeof(buffer));
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+            {
+                fprintf(stderr, "Error reading inotify events: %s\n", strerror(errno));
+                close(fd);
+                return 1;
+            }
+            for (char *p = buffer; p < buffer + n;)
+            {
+                struct inotify_event *event = (struct inotify_event *)p;
+                if (event->len && strcmp(event->name, base) == 0)
+                    changed = 1;
+                p += sizeof(struct inotify_event) + event->len;
+            }
+        }
+        clock_gettime(CLOCK_MONOTONIC, &start);
+
+        // 一次保存可能产生好几个事件，把已经到达的一起读掉
+        struct pollfd pfd = {fd, POLLIN, 0};
+        while (poll(&pfd, 1, 0) > 0)
+        {
+            if (read(fd, buffer, sizeof(buffer)) <= 0)
+                break;
+        }
+
+        status = rebuild(&state, source_path, output_name, options, &stats, &start);
+        report(status, output_name, &stats);
+    }
+}